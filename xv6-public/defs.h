@@ -2,6 +2,9 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockstat;
+struct lockstatent;
+struct mlfqparam;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -9,15 +12,43 @@ struct rtcdate;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+
+// A CPU's place in line for a spinlock, see acquire().
+struct qnode {
+  struct qnode *volatile next;  // Next in line, 0 if none yet
+  volatile uint wait;           // Spins while 1, until the one before hands over
+};
+
+#ifdef LOCKSTAT
+// How much a lock is used and waited for, see spinlock.c.
+// Updated under the lock itself.
+struct lockstat {
+  struct lockstat *next;  // Next registered lock
+  char *name;
+  int sleep;              // A sleeplock's, not a spinlock's
+  uint acquires;
+  uint contended;         // Acquisitions that had to wait
+  uint64 wait;            // TSC cycles spent waiting
+  uint64 maxhold;         // Longest held, in TSC cycles
+  uint64 start;           // TSC when last acquired
+};
+#endif
 
 struct spinlock {
-  uint locked;       // Is the lock held?
+  struct qnode *volatile tail;  // Last in line, the holder if alone; 0 if free
+  struct qnode *node;           // The holder's place in line
+#ifdef LOCKSTAT
+  struct lockstat stat;
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#ifdef LOCKDEBUG
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#endif
 };
 
 typedef struct _thread_t{
@@ -25,30 +56,6 @@ typedef struct _thread_t{
   int group_id;
 }thread_t;
 
-typedef struct __my_sem_t{
-  int value;
-  int chan;
-  struct spinlock lock;
-}xem_t;
-
-typedef struct __my_rwlock_t{
-  xem_t lock;
-  xem_t writelock;
-  int readers;
-}rwlock_t;
-
-// semaphore.c
-int xem_init(xem_t*);
-int xem_wait(xem_t*);
-int xem_post(xem_t*);
-
-// rwlock.c
-int rwlock_init(rwlock_t*);
-int rwlock_acquire_readlock(rwlock_t*);
-int rwlock_acquire_writelock(rwlock_t*);
-int rwlock_release_readlock(rwlock_t*);
-int rwlock_release_writelock(rwlock_t*);
-
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
@@ -75,6 +82,11 @@ int             filewrite(struct file*, char*, int n);
 int             pos_write(struct file*, char*, int, int);
 int             pos_read(struct file*, char*, int, int);
 
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint, int, int, uint);
+int             futex_wake(uint, int, uint);
+
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
@@ -118,6 +130,7 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(int, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -158,28 +171,55 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             sleep_timeout(void*, struct spinlock*, int);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeup_io(void*);
+int             wakeup_n(void*, int);
 int             yield(void);
+int             yield_to(int);
+int             thread_setprio(int, int);
+int             thread_running(uint);
 int             getlev(void);
+int             mlfq_setparam(struct mlfqparam*);
+void            mlfq_getparam(struct mlfqparam*);
+void            mlfqboost(void);
+int             wakelat(int, uint*);
 int             set_cpu_share(int);
+int             set_deadline(int, int);
+int             set_affinity(int, int);
+int             get_affinity(int);
+int             sgroup_create(int);
+int             sgroup_weight(int);
+int             sgroup_cputime(int);
+void            sgjoin(struct proc*, int, int);
+void            sgleave(struct proc*);
+void            pilend(struct proc*);
+void            piacquire(struct proc*);
+void            pirelease(struct proc*);
+void            pilendsp(uint);
+void            pireleasesp(uint);
+int             getcputime(void);
 struct proc*    find_unused(void);
 struct proc*    find_thread(int, int);
 void            sleep_main_thread(struct proc*);
-void acquire_ptable();
-void release_ptable();
+void acquire_group(struct proc*);
+void release_group(struct proc*);
+void release_unused(struct proc*);
 void rm_thread(struct proc*);
 void add_thread(struct proc*);
-int  update_next_t(struct proc*);
-void init_next_t(struct proc*, int);
-int is_holding_ptable();
-int thread_swtch(struct context**, struct proc*);
+void            placethread(struct proc*);
+void            stopthreads(void);
+void            runqadd(struct proc*);
+void            runqrm(struct proc*);
+extern struct spinlock wait_lock;
 
 // lwp.c
 int             thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg);
 void            thread_exit(void* retval);
 int             thread_join(thread_t t, void** retval);
+void            thread_free(struct proc*);
 
 
 // swtch.S
@@ -193,6 +233,10 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+void            lockstat_register(struct lockstat*, char*, int);
+void            lockstat_acquired(struct lockstat*, uint64);
+void            lockstat_released(struct lockstat*);
+int             lockstat(struct lockstatent*, int, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -219,10 +263,14 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            timerstart(struct timer*, int);
+int             timerstop(struct timer*);
+void            timertick(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+extern uint     tsc_per_unit;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -244,6 +292,9 @@ int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            switchkstack(struct proc*);
+void            tlbshootdown(pde_t*);
+void            tlbcheck(struct cpu*);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 //static pte_t*   walkpgdir(pde_t*, const void*, int);
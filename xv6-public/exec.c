@@ -2,8 +2,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "defs.h"
+#include "proc.h"
 #include "x86.h"
 #include "elf.h"
 
@@ -19,6 +19,11 @@ exec(char *path, char **argv)
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
+  // Only a main thread can replace the image of its process: it
+  // takes over the pid, which a thread does not have.
+  if(curproc->pid == -1)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -93,6 +98,9 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
+  // The other threads run in the old image: stop them first.
+  stopthreads();
+
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
@@ -0,0 +1,116 @@
+// Futexes.
+//
+// futex_wait() puts the caller to sleep on a word of user memory as long
+// as the word holds the value the caller expects, and futex_wake() wakes
+// up processes sleeping on a word. User-space locks built on them (see
+// ulib.c) take and release a free lock with an atomic instruction alone
+// and only enter the kernel when they have to wait or wake someone.
+//
+// A word is known by its physical address, found through the page table
+// of the caller's LWP group, so that all the threads of a group meet on
+// it; its kernel address is the channel sleepers sleep on. Checking the
+// word and going to sleep happen under the lock of the word's bucket,
+// which futex_wake() takes too, so a wakeup cannot slip in between.
+//
+// A lock in user memory can name its holder to both (owner, an address
+// on the holder's stack) for priority inheritance: the waiter lends its
+// priority to the holder before it sleeps, and the holder gives it back
+// as it wakes the waiters (see pilendsp()).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEX 64
+
+extern pte_t* walkpgdir(pde_t*, const void*, int);
+
+struct {
+  struct spinlock lock;
+} futexes[NFUTEX];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futexes[i].lock, "futex");
+}
+
+// The kernel address of the word at user address addr of the caller's
+// group, or 0 if there is no such word.
+static int*
+futexword(uint addr)
+{
+  struct proc *g = myproc()->lwpgroup;
+  pte_t *pte;
+
+  if(addr % 4 != 0 || addr >= g->sz)
+    return 0;
+  pte = walkpgdir(g->pgdir, (char*)addr, 0);
+  if(pte == 0 || (*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U))
+    return 0;
+  return (int*)(P2V(PTE_ADDR(*pte)) + (addr & (PGSIZE - 1)));
+}
+
+static struct spinlock*
+futexlock(int *word)
+{
+  return &futexes[((uint)word >> 2) % NFUTEX].lock;
+}
+
+// Sleep on the word at addr if it holds val, until woken up by
+// futex_wake() or, if n >= 0, for n ticks at most, lending the caller's
+// priority to owner's thread meanwhile if owner is not 0. Returns 0 if
+// woken up, -1 if the word did not hold val, the time ran out or the
+// caller was killed. Callers check their word again either way.
+int
+futex_wait(uint addr, int val, int n, uint owner)
+{
+  struct spinlock *lk;
+  int *word;
+  int r = 0;
+
+  if((word = futexword(addr)) == 0)
+    return -1;
+  lk = futexlock(word);
+  acquire(lk);
+  if(*(volatile int*)word != val || myproc()->killed){
+    release(lk);
+    return -1;
+  }
+  if(owner)
+    pilendsp(owner);
+  if(n < 0)
+    sleep(word, lk);
+  else
+    r = sleep_timeout(word, lk, n);
+  release(lk);
+  return r;
+}
+
+// Wake up at most n processes sleeping on the word at addr, those that
+// have waited longest first, after owner's thread, if owner is not 0,
+// gives back what it was lent. Returns how many were woken up.
+int
+futex_wake(uint addr, int n, uint owner)
+{
+  struct spinlock *lk;
+  int *word;
+  int r;
+
+  if((word = futexword(addr)) == 0)
+    return -1;
+  if(owner)
+    pireleasesp(owner);
+  lk = futexlock(word);
+  acquire(lk);
+  r = wakeup_n(word, n);
+  release(lk);
+  return r;
+}
@@ -113,6 +113,20 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send a fixed interrupt with the given vector to the CPU with
+// the given APIC ID. Must be called with interrupts disabled, so
+// that nothing else on this CPU uses the ICR in between.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
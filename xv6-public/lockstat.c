@@ -0,0 +1,113 @@
+/**
+ * Kernel lock contention profiler.
+ *
+ * usage: lockstat [-r] [command [args...]]
+ *
+ * Prints, for every kernel lock name, how many times the locks of that
+ * name were acquired, how many of those had to wait, the time spent
+ * waiting in kilocycles of the TSC and the longest any was held, in
+ * cycles, most waited for first. With -r the counts are cleared after
+ * they are read. With a command the counts are cleared, the command is
+ * run, and what it and everything else did meanwhile is printed. Needs
+ * a kernel built with make LOCKSTAT=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NLOCKSTAT (512)   /* (locks) */
+#define NNAME     (64)    /* (distinct names and kinds) */
+
+struct lockstatent ents[NLOCKSTAT];
+struct lockstatent sums[NNAME];
+
+void
+report(int reset)
+{
+  struct lockstatent *e, *s, t;
+  int i, j, n, nsum;
+
+  if((n = lockstat(ents, NLOCKSTAT, reset)) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+    exit();
+  }
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+
+  // Add up the locks of a name, like all the buffers' sleeplocks.
+  nsum = 0;
+  for(i = 0; i < n; i++){
+    e = &ents[i];
+    for(j = 0; j < nsum; j++)
+      if(sums[j].sleep == e->sleep && strcmp(sums[j].name, e->name) == 0)
+        break;
+    if(j == nsum){
+      if(nsum == NNAME)
+        continue;
+      memset(&sums[nsum], 0, sizeof(sums[nsum]));
+      strcpy(sums[nsum].name, e->name);
+      sums[nsum++].sleep = e->sleep;
+    }
+    s = &sums[j];
+    s->acquires += e->acquires;
+    s->contended += e->contended;
+    s->waitkc += e->waitkc;
+    if(e->maxhold > s->maxhold)
+      s->maxhold = e->maxhold;
+  }
+
+  for(i = 1; i < nsum; i++){
+    t = sums[i];
+    for(j = i; j > 0 && sums[j - 1].waitkc < t.waitkc; j--)
+      sums[j] = sums[j - 1];
+    sums[j] = t;
+  }
+
+  printf(1, "name            kind  acquires  contended  wait(kc)  maxhold(c)\n");
+  for(i = 0; i < nsum; i++){
+    s = &sums[i];
+    if(s->acquires == 0)
+      continue;
+    printf(1, "%s", s->name);
+    for(j = strlen(s->name); j < LOCKNAME; j++)
+      printf(1, " ");
+    printf(1, "%s  %d  %d  %d  %d\n", s->sleep ? "sleep" : "spin ",
+           s->acquires, s->contended, s->waitkc, s->maxhold);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int reset = 0;
+  int pid;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    reset = 1;
+    argc--;
+    argv++;
+  }
+  if(argc < 2){
+    report(reset);
+    exit();
+  }
+
+  if(lockstat(0, 0, 1) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+    exit();
+  }
+  if((pid = fork()) < 0){
+    printf(2, "lockstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    printf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+  report(reset);
+  exit();
+}
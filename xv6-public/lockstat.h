@@ -0,0 +1,11 @@
+// Lock contention statistics, see lockstat().
+#define LOCKNAME 16
+
+struct lockstatent {
+  char name[LOCKNAME];        // Name the lock was initialized with
+  int sleep;                  // 1 for a sleeplock, 0 for a spinlock
+  uint acquires;              // Times acquired
+  uint contended;             // Times acquired after waiting for it
+  uint waitkc;                // Time spent waiting for it, in 1024 TSC cycles
+  uint maxhold;               // Longest held, in TSC cycles
+};
@@ -13,6 +13,7 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
 {
   struct proc *p;
   struct proc *curproc = myproc();
+  struct proc *main_thread = curproc->lwpgroup;
   //uint sz;
   char* sp;
 
@@ -23,23 +24,36 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
     return -1;
   }
 
-  acquire_ptable();
+  acquire_group(curproc);
 
   p->state = EMBRYO;
   p->pid = -1;         // pid=-1 indicates that this is a LWP, not a normal process.
-  p->lwpgroup = curproc;
-  p->waiting_tid = -1;
+  p->lwpgroup = main_thread;
   p->parent = 0;
+  p->killed = 0;
 
-  p->timequant = 1;
-  p->s_link = NULL;
+  // Level and share are the group's; the rest is the thread's own.
+  p->level = main_thread->level;
+  p->slice = 0;
+  p->hidx = -1;
+  p->queued = 0;
   p->share = 0;
   p->stride = -1;
   p->pass = 0;
+  p->lag = 0;
+  p->cputime = 0;
+  p->pilevel = 0;
+  p->boosted = 0;
+  p->pipass = 0;
+  p->pilocks = 0;
+  p->cpu = -1;
+  p->lastrun = 0;
+  p->tweight = TWEIGHT;
 
   // Allocate kernel stack (1page)
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    release_group(curproc);
+    release_unused(p);
     return -1;
   }
   sp = p->kstack + KSTACKSIZE; // point sp to the top of the kernel stack
@@ -58,7 +72,7 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
   p->context->eip = (uint)forkret;
   
   // Allocate a page in address space for this thread's ustack
-  struct proc* pptr = curproc;
+  struct proc* pptr = main_thread;
   pte_t* pte;
   uint sz;
   while(pptr){
@@ -68,7 +82,8 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
       if((sz = allocuvm(curproc->pgdir, p->ustack - PGSIZE, p->ustack)) == 0){
         kfree(p->kstack);
         p->kstack = 0;
-        p->state = UNUSED;
+        release_group(curproc);
+        release_unused(p);
         return -1;
       }
       break;
@@ -77,6 +92,10 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
   }
   if(!pptr){
     cprintf("could not find space for stack\n");
+    kfree(p->kstack);
+    p->kstack = 0;
+    release_group(curproc);
+    release_unused(p);
     return -1;
   }
   /*uint sz;
@@ -87,7 +106,10 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
     p->state = UNUSED;
   }*/
   //cprintf("allocated ustack for thread %d at %d\n", curproc->thread_count, p->ustack);
-  curproc->sz = sz;
+  // A stack below the top of memory (a freed one) does not shrink it.
+  if(sz > main_thread->sz)
+    main_thread->sz = sz;
+  curproc->sz = main_thread->sz;
   switchuvm(curproc);
   
   /*if((sz = allocuvm(curproc->pgdir, sz, sz + PGSIZE))==0){
@@ -116,7 +138,7 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
   *(int*)sp = fake_pc;
 
   p->pgdir = curproc->pgdir;
-  p->sz = curproc->sz;
+  p->sz = main_thread->sz;
 
   // The new thread will return to trapret, restoring these esp and eip values.
   // eip: start_routine, esp: user stack specific to this thread.
@@ -130,26 +152,21 @@ int thread_create(thread_t* thread, void* (*start_routine) (void*), void* arg)
   //cprintf("thread's esp value: %d\n", p->tf->esp);
   //cprintf("return address: %x, arg: %x\n", *(int*)(p->tf->esp), *(int*)(p->tf->esp + 4));
   
-  if(curproc->thread_count == 1){
-    init_next_t(p, curproc->pid);
-    curproc->t_link = p;
-    p->t_link = NULL;
-  }
-  else{
-    add_thread(p);
-  }
+  add_thread(p);
    
-  p->thread_id = curproc->next_tid++;
+  p->thread_id = main_thread->next_tid++;
   
   // Initialize thread_t
-  thread->group_id = curproc->pid;
+  thread->group_id = main_thread->pid;
   thread->thread_id = p->thread_id;
   
-  curproc->thread_count++;
+  main_thread->thread_count++;
+  main_thread->tweights += p->tweight;
  
-  p->state = RUNNABLE;
+  // The new thread is scheduled on its own, maybe on another CPU.
+  placethread(p);
   
-  release_ptable();
+  release_group(curproc);
   return 0;
 }
 
@@ -158,31 +175,34 @@ thread_exit(void* retval)
 {
   struct proc* p = myproc();
   struct proc* main_thread = p->lwpgroup;
-  
+  uint sz;
+
+  // The main thread might be waiting in thread_join() or stopthreads().
+  // It checks for ZOMBIE holding wait_lock, as wait() does for exit().
+  acquire(&wait_lock);
+  wakeup(main_thread);
+
   // Set to ZOMBIE status and deallocate in main thread with thread_join.
-  acquire_ptable(); 
+  acquire_group(p); 
   p->state = ZOMBIE;
   p->retval = (int)retval;
  
   main_thread->thread_count--;
+  main_thread->tweights -= p->tweight;
   rm_thread(p);
   
-  // If main thread is waiting in thread_join, wake it up.
-  if(main_thread->waiting_tid == p->thread_id){
-    main_thread->waiting_tid = -1;
-  }
-  
-  uint sz;
   //deallocate user stack of this thread
   if((sz = deallocuvm(main_thread->pgdir, p->ustack, p->ustack-PGSIZE)) == 0){
     cprintf("failed to deallocate ustack at thread exit\n");
   }
-  main_thread->sz = sz;
+  // Only a stack at the top of memory shrinks it.
+  if(p->ustack == main_thread->sz)
+    main_thread->sz = sz;
+  release(&wait_lock);
 
-  //cprintf("thread %d exit with retval: %d\n", p->thread_id, (int)p->retval);
-  if(thread_swtch(&p->context, main_thread) == -1){
-    sched();
-  }
+  runqrm(p);
+  sched();
+  panic("zombie thread_exit");
 }
 
 int 
@@ -197,54 +217,54 @@ thread_join(thread_t thread, void** retval)
   p = find_thread(tid, gid);
   
   // Could not find proc structure for this thread.
-  if(!p){
+  if(!p || p->lwpgroup != curproc->lwpgroup){
     return -1;
   }
 
-  acquire_ptable();
   // Fall into sleep if the thread has not exited yet.
-  if(p->state != ZOMBIE){
-    curproc->waiting_tid = tid;
-    curproc->state = RUNNABLE;
-    release_ptable();
-    //cprintf("calling yield in thread_join tid%d\n", tid);
-    yield();
-    acquire_ptable();
+  acquire(&wait_lock);
+  while(p->state != ZOMBIE){
+    // Joined by someone else in the meantime.
+    if(p->state == UNUSED || p->lwpgroup != curproc->lwpgroup || curproc->killed){
+      release(&wait_lock);
+      return -1;
+    }
+    sleep(curproc->lwpgroup, &wait_lock);
   }
 
+  acquire_group(curproc);
   // save ret value
   *retval = (void*)p->retval;
+  thread_free(p);
+  release_group(curproc);
+  release(&wait_lock);
+
+  return 0;
+}
+
+// Free the slot of the exited thread p.
+// p's group lock and wait_lock should be acquired in caller.
+void
+thread_free(struct proc* p)
+{
+  // The main thread keeps the CPU time of its joined threads.
+  p->lwpgroup->cputime += p->cputime;
 
   // deallocate kernel stack of this thread
   kfree(p->kstack);
   p->kstack = 0;
 
-  
- /* int fd;
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      fileclose(p->ofile[fd]);
-      p->ofile[fd] = 0;
-    }
-  }
-
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-  */
   p->pid = 0;
-  p->lwpgroup = NULL;
   p->thread_id = 0;
   p->killed = 0;
-  p->state = UNUSED;
   p->name[0] = 0;
   p->t_link = 0;
-  p->s_link = 0;
+  p->hidx = -1;
   p->pgdir = 0;
 
-  release_ptable();
-
-  return 0;
+  // The slot's own lock guards it going UNUSED (see allocproc()).
+  acquire(&p->lock);
+  p->lwpgroup = NULL;
+  p->state = UNUSED;
+  release(&p->lock);
 }
@@ -28,6 +28,8 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  timerinit();     // timer wheel
+  futexinit();     // futex buckets
   binit();         // buffer cache
   fileinit();      // file table
   ideinit();       // disk 
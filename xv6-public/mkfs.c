@@ -260,7 +260,7 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, y, bn;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,6 +273,25 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
+    } else if(fbn >= NDIRECT + NINDIRECT){
+      // Through the double indirect block.
+      bn = fbn - NDIRECT - NINDIRECT;
+      assert(bn < NDINDIRECT);
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      if(indirect[bn / NINDIRECT] == 0){
+        indirect[bn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      y = xint(indirect[bn / NINDIRECT]);
+      rsect(y, (char*)indirect);
+      if(indirect[bn % NINDIRECT] == 0){
+        indirect[bn % NINDIRECT] = xint(freeblock++);
+        wsect(y, (char*)indirect);
+      }
+      x = xint(indirect[bn % NINDIRECT]);
     } else {
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
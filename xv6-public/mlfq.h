@@ -0,0 +1,14 @@
+// MLFQ scheduler parameters, see mlfq_setparam().
+// Levels are numbered from 0, the lowest; new and boosted processes
+// start at the top level, nlevel-1. The lowest level has no allotment.
+#define NMLFQ 8               // most levels there can be
+#define MLFQ_MAXQUANTUM 100   // longest time quantum, in ticks
+#define MLFQ_MAXALLOT 10000   // longest time allotment, in ticks
+#define NWAKELAT 16           // buckets of a wakeup latency histogram, see wakelat()
+
+struct mlfqparam {
+  int nlevel;                 // Number of levels, 1 to NMLFQ
+  int quantum[NMLFQ];         // Time quantum of each level, in ticks
+  int allot[NMLFQ];           // Time allotment of each level, in ticks
+  int boost;                  // Ticks between priority boosts
+};
@@ -1,6 +1,7 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NQNODE       16  // maximum number of spinlocks a CPU holds at once
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -12,6 +13,9 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       50000  // size of file system in blocks
 #define STRIDE_DIVIDEND 10000 // large number used to calculate stride in stride scheduling
+#define MAXSHARE     80  // max CPU share stride processes can reserve on one CPU
+#define TICKFRAC    100  // CPU time is accounted in 1/TICKFRAC of a timer tick
+#define TWEIGHT      10  // default weight of a thread in its LWP group
 #define SET_NT       0x4000
 #ifndef NULL
 #define NULL ((void*)0)
@@ -6,25 +6,244 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
-
+#include "traps.h"
+#include "timer.h"
+#include "mlfq.h"
+
+// There is no lock over the whole table. Each process has its own lock,
+// p->lock, and the scheduling state of a process or thread (state, chan,
+// killed, its place on a run queue) is guarded by the lock of its LWP
+// group's main thread, p->lwpgroup->lock, which also guards the group's
+// own state (level, share, thread list). That lock is held across
+// swtch() into and out of each thread. The threads of a group are
+// scheduled on their own and may run on several CPUs at once; they only
+// meet at the group lock when they switch. A slot goes from UNUSED to
+// EMBRYO and back under its own p->lock.
+// A sleeping process is also linked on the wait queue of its channel
+// (see waitq below), under that queue's lock.
+// Lock order: wait_lock, then the timer wheel lock, then wait queue
+// locks, then group locks, then a thread's own lock, then run queue
+// locks in index order, then mlfqstr.lock. The lock passed to sleep()
+// comes before all of them.
 struct {
-  struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// Wait queues.
+// Sleepers are hashed by channel into NWAITQ buckets, each a FIFO list
+// linked through p->w_next/w_prev, so that a wakeup only looks at the
+// processes sleeping on channels of the same bucket instead of all of
+// ptable. A process is on its bucket exactly while it is SLEEPING.
+#define NWAITQ 64
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+};
+
+struct waitq waitqs[NWAITQ];
+
+static struct waitq*
+waitqof(void *chan)
+{
+  // Channels are mostly addresses of structs: drop the low bits that
+  // are the same for all of them and fold in the rest.
+  uint h = (uint)chan * 2654435761U;
+  return &waitqs[h >> 26];
+}
+
+static void
+wqpush(struct waitq *wq, struct proc *p)
+{
+  p->w_next = 0;
+  p->w_prev = wq->tail;
+  if(wq->tail)
+    wq->tail->w_next = p;
+  else
+    wq->head = p;
+  wq->tail = p;
+}
+
+static void
+wqunlink(struct waitq *wq, struct proc *p)
+{
+  if(p->w_prev)
+    p->w_prev->w_next = p->w_next;
+  else
+    wq->head = p->w_next;
+  if(p->w_next)
+    p->w_next->w_prev = p->w_prev;
+  else
+    wq->tail = p->w_prev;
+  p->w_next = p->w_prev = 0;
+}
+
+// Guards the parent links of all processes, so that wait() and exit()
+// of unrelated processes only meet here and not on their own locks.
+struct spinlock wait_lock;
+
+// Guards nextpid.
+struct spinlock pid_lock;
+
 // protected data for scheduling tasks
 struct{
-  uint priboosttime;         // Counts num of ticks passed since last pri boost. Checked at process yield.
-  uint mlfq_pass;            // Pass value of mlfq processes
-  uint mlfq_stride;          // Stride value of mlfq processes -> changes whenever set_cpu_share called.
-  int mlfq_proc_cnt;         // Number of processes in the mlfq. Used when finding min pass value in stride scheduler.
-  int stride_share;          // Sum of CPU share non-mlfq processes are occupying.
-  struct proc* stride_head;  // Linked list of processes in stride queue.
-  int qlevels[3];            // Number of processes in each mlfq level.
+  int stride_share;          // Sum of CPU share non-mlfq processes are occupying, over all CPUs.
   struct spinlock lock;
-  struct proc * next_t [NPROC];
 }mlfqstr;
 
+// MLFQ parameters, see mlfq_setparam(). Written under mlfqstr.lock and
+// read without it: a group takes up new values when it next changes
+// level, and one left above the top level by a smaller level count goes
+// down to the top level when it is next charged.
+static struct mlfqparam mlfqparam = {
+  .nlevel = 3,
+  .quantum = { 20, 10, 5 },
+  .allot = { 0, 40, 20 },
+  .boost = 200,
+};
+
+// The level new and boosted processes start at.
+static uint
+toplevel(void)
+{
+  return mlfqparam.nlevel - 1;
+}
+
+// Per-CPU run queues.
+// Each CPU's scheduler() only picks from its own queue, so the mlfq
+// counters and the stride list are kept here, one copy per CPU, each
+// under its own lock. A process or thread lives on runqs[p->rqid]; an
+// idle CPU pulls runnable ones over from the busiest queue (steal()).
+// The threads of a mlfq group are spread over the queues like processes
+// and wait on the list of their group's level; the threads of a stride
+// group stay on the queue its share is reserved on, each with a heap
+// entry of its own.
+// Shares are reserved per queue: a stride process is placed on a queue
+// that still has room for its share (placeshare()), so that each CPU
+// hands out at most MAXSHARE percent of itself.
+// Lock order: group locks (see ptable), then run queue locks in index
+// order, then mlfqstr.lock. A process's rqid only changes while it is
+// waiting on a queue (steal()) or by the process itself (set_cpu_share()).
+// The mlfq counters and lists count threads, not groups; nstride and the
+// shares count stride groups.
+struct runq {
+  struct spinlock lock;
+  uint priboosttime;         // Ticks at the last priority boost of this queue. Checked at each timer tick.
+  int stride_share;          // Sum of the shares of the stride processes on this queue.
+  uint mlfq_stride;          // Stride value of the mlfq processes on this queue.
+  uint64 mlfq_pass;          // Pass value of the mlfq processes on this queue.
+  int mlfq_lag;              // mlfq_pass - vtime when the mlfq entry last left the heap.
+  uint64 vtime;              // Virtual time: the least pass picked so far. Never goes back.
+  int mlfq_proc_cnt;         // Number of runnable or running mlfq processes on this queue.
+  int stride_cnt;            // Number of runnable or running stride processes on this queue.
+  int nstride;               // Number of stride processes on this queue, sleeping or not.
+  struct proc* sheap[NPROC+1]; // Min-heap on pass of waiting stride processes and the mlfq entry.
+  int nsheap;                // Number of entries in sheap.
+  int mlfq_hidx;             // Index of the mlfq entry in sheap, -1 if not in it.
+  struct proc* qhead[NMLFQ]; // FIFO list of processes waiting in each mlfq level.
+  struct proc* qtail[NMLFQ];
+  int qlevels[NMLFQ];        // Number of processes waiting in each mlfq level list.
+  struct proc* ehead;        // List of EDF processes waiting on this queue, in no order.
+  struct proc* etail;
+  int edf_cnt;               // Number of runnable or running EDF processes on this queue.
+  int edf_share;             // Sum of the CPU shares, in percent, EDF processes reserved here.
+  // Wakeup to run latency histograms, of wakeups from I/O ([1]) and of
+  // the others ([0]), see wakelat(). Only this CPU's scheduler() adds
+  // to them, without the lock.
+  uint wakelat[2][NWAKELAT];
+};
+
+struct runq runqs[NCPU];
+
+// Share groups.
+// A share group holds a CPU share, which may be more than one CPU's
+// worth, for all its member processes together. Each member is a stride
+// process with a part of it in proportion to its weight, at least 1 and
+// no more than its run queue has room for. The group's share counts
+// against the total of all stride shares once, when the group is
+// created; members reserve their parts on their own queues. A fork child
+// joins its parent's group with its weight, and the parts of all
+// members are worked out again whenever one joins, leaves or changes
+// weight. A group goes away with its last member.
+// sgtable.lock guards the groups and the sgroup and weight fields of
+// processes, and comes before the group locks.
+#define NSGROUP 16
+#define MAXWEIGHT 1000
+
+struct sgroup {
+  int share;                 // Percent of a CPU for all members; 0 if the slot is free.
+  int weight;                // Sum of the weights of the members.
+  uint cputime;              // CPU time of members that left, in 1/TICKFRAC ticks.
+};
+
+struct {
+  struct spinlock lock;
+  struct sgroup g[NSGROUP];
+} sgtable;
+
+// The mlfq takes part in stride scheduling as a single heap entry that
+// stands for all the mlfq processes of the queue, with pass mlfq_pass.
+#define MLFQ_ENTRY ((struct proc*)-1)
+
+// Scheduling classes.
+// What a run queue does with a process or thread depends on the class of
+// its LWP group, given by the group's level: earliest deadline first
+// (EDF_LEVEL, see set_deadline()), stride (-1, see set_cpu_share()) or
+// mlfq (0 to the top level, see mlfq_setparam()). Each class keeps its
+// own waiting processes on the queue and counts its runnable and running
+// ones there; the rest of the scheduler only goes through these hooks,
+// all called with the lock of the run queue held (and the group lock of
+// p, where there is a p).
+// Classes are asked for work in order: EDF first, then stride, whose
+// heap holds the mlfq entry and so decides when the mlfq runs.
+struct schedclass {
+  char *name;
+  int pinned;          // Groups stay on the queue their CPU time is reserved on.
+  // p became runnable: count it and queue it.
+  void (*enqueue)(struct runq*, struct proc*);
+  // p is not runnable any more: stop counting it and take it off the queue.
+  void (*dequeue)(struct runq*, struct proc*);
+  // Take the next process to run off the queue, or return 0 if none.
+  struct proc* (*pick_next)(struct runq*);
+  // p ran and is still runnable: queue it again.
+  void (*put_prev)(struct runq*, struct proc*);
+  // Take waiting p off the queue; returns 0 if it was not waiting.
+  int (*take)(struct runq*, struct proc*);
+  // Charge running p for units of CPU time; returns 1 if p has to give
+  // up the CPU right away.
+  int (*tick)(struct runq*, struct proc*, uint units);
+  // Returns 1 if running p is to give up the CPU at a timer tick.
+  int (*yield)(struct runq*, struct proc*);
+  // Returns 1 if the waiting processes of this class take the CPU from
+  // those of the classes below it at a timer tick. May be null.
+  int (*preempt)(struct runq*);
+  // The group of p leaves the class: give back what it reserved. May be null.
+  void (*leave)(struct runq*, struct proc*);
+  // waiter is about to wait for a lock p holds: make p, off its queue,
+  // at least as urgent as waiter until it releases its locks (see
+  // pilend()). May be null.
+  void (*lend)(struct runq*, struct proc*, struct proc *waiter);
+};
+
+#define EDF_LEVEL (-2)
+#define EDF_MAXPERIOD 10000   // ticks
+
+static struct schedclass edfclass, strideclass, mlfqclass;
+
+static struct schedclass *sclasses[] = { &edfclass, &strideclass, &mlfqclass, 0 };
+
+static struct schedclass*
+classof(struct proc *p)
+{
+  uint level = p->lwpgroup->level;
+
+  if(level == EDF_LEVEL)
+    return &edfclass;
+  if(level == -1)
+    return &strideclass;
+  return &mlfqclass;
+}
 
 static struct proc *initproc;
 
@@ -32,81 +251,538 @@ int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+// Append p to the tail of its level's list on its run queue, which is
+// the level of its group or the one lent to it, whichever is higher,
+// but no higher than the top level, and the top level if p was boosted.
+// A process waits on a list only while it is RUNNABLE and off the CPU;
+// scheduler() pops it when it runs and puts it back when it yields.
+// lock of the process's run queue should be acquired in caller
+static void
+qpush(struct proc* p)
+{
+  struct runq *rq = &runqs[p->rqid];
+  uint level = p->lwpgroup->level;
+
+  if(p->queued || level >= NMLFQ)
+    return;
+  // A level lent by a waiter for a lock p holds counts if higher.
+  if(p->pilevel > level)
+    level = p->pilevel;
+  if(p->boosted || level > toplevel())
+    level = toplevel();
+  p->qlevel = level;
+  p->q_next = NULL;
+  p->q_prev = rq->qtail[level];
+  if(rq->qtail[level])
+    rq->qtail[level]->q_next = p;
+  else
+    rq->qhead[level] = p;
+  rq->qtail[level] = p;
+  rq->qlevels[level]++;
+  p->queued = 1;
+}
+
+// Take p off its level's list, wherever it is in the list.
+// lock of the process's run queue should be acquired in caller
+static void
+qunlink(struct proc* p)
+{
+  struct runq *rq = &runqs[p->rqid];
+
+  if(!p->queued)
+    return;
+  if(p->q_prev)
+    p->q_prev->q_next = p->q_next;
+  else
+    rq->qhead[p->qlevel] = p->q_next;
+  if(p->q_next)
+    p->q_next->q_prev = p->q_prev;
+  else
+    rq->qtail[p->qlevel] = p->q_prev;
+  p->q_next = p->q_prev = NULL;
+  rq->qlevels[p->qlevel]--;
+  p->queued = 0;
+}
+
+// Move the LWP group of p to another mlfq level and reset its time
+// quantum, time allotment and tickcount for that level. p itself, if
+// waiting, moves to the list of the new level; other waiting threads of
+// the group move when they are next queued.
+// p's group lock and lock of p's run queue should be acquired in caller;
+// the group lock alone if p is not waiting.
+static void
+setlevel(struct proc* p, uint level)
+{
+  struct proc *g = p->lwpgroup;
+  int queued = p->queued;
+
+  qunlink(p);
+  g->level = level;
+  g->tickcount = 0;
+  g->timequant = mlfqparam.quantum[level];
+  g->timeallot = mlfqparam.allot[level];
+  if(queued)
+    qpush(p);
+}
 
 // remove a process from mlfq when its state changes from RUNNABLE to different state
-// ptable lock should be acquired in caller
+// lock of the process's run queue should be acquired in caller
 void 
 mlfqrm(struct proc* p){
-  if(p->level >= 0 && p->level <= 2)
-    mlfqstr.qlevels[p->level]--;
-  mlfqstr.mlfq_proc_cnt--;
+  struct runq *rq = &runqs[p->rqid];
+
+  qunlink(p);
+  rq->mlfq_proc_cnt--;
 }
 
 // add a process to mlfq when its status is changed to RUNNABLE
-// ptable lock should be acquired in caller
+// lock of the process's run queue should be acquired in caller
 void 
 mlfqadd(struct proc* p)
 {
-  if(p->level >= 0 && p->level <= 2)
-    mlfqstr.qlevels[p->level]++;
-  mlfqstr.mlfq_proc_cnt++;
+  struct runq *rq = &runqs[p->rqid];
+
+  qpush(p);
+  rq->mlfq_proc_cnt++;
 }
-  
-void 
-striderm(struct proc * p)
+
+// Number of mlfq processes waiting on rq's level lists.
+static int
+mlfqready(struct runq *rq)
 {
-  struct proc * pptr = mlfqstr.stride_head;
+  int level, n = 0;
 
-  // If p is at the head of the stride queue.
-  if(pptr == p)
-    mlfqstr.stride_head = pptr->s_link; 
+  for(level = 0; level < NMLFQ; level++)
+    n += rq->qlevels[level];
+  return n;
+}
 
-  else{
-    while(pptr){
-      if(pptr->s_link == p){
-        pptr->s_link = p->s_link;
-        break;
-      }
-      pptr = pptr->s_link;
-    } 
+//PAGEBREAK!
+// Stride heap.
+// Each run queue keeps its waiting stride processes, plus the mlfq entry
+// while the mlfq has processes waiting, in a binary min-heap ordered by
+// pass, so scheduler() finds the smallest pass in O(1) and inserting,
+// removing and re-charging an entry are O(log n).
+// lock of the run queue should be acquired in callers.
+
+// A pass lent by a waiter for a lock the process holds counts if lower.
+static uint64
+hpass(struct runq *rq, struct proc *e)
+{
+  if(e == MLFQ_ENTRY)
+    return rq->mlfq_pass;
+  if(e->pipass && e->pipass < e->pass)
+    return e->pipass;
+  return e->pass;
+}
+
+static void
+hset(struct runq *rq, int i, struct proc *e)
+{
+  rq->sheap[i] = e;
+  if(e == MLFQ_ENTRY)
+    rq->mlfq_hidx = i;
+  else
+    e->hidx = i;
+}
+
+static void
+siftup(struct runq *rq, int i)
+{
+  struct proc *e = rq->sheap[i];
+  int parent;
+
+  while(i > 0){
+    parent = (i - 1) / 2;
+    if(hpass(rq, rq->sheap[parent]) <= hpass(rq, e))
+      break;
+    hset(rq, i, rq->sheap[parent]);
+    i = parent;
   }
-  
-  p->s_link = NULL;
+  hset(rq, i, e);
+}
 
-  // reset the mlfq share and mlfq stride
-  mlfqstr.stride_share -= p->share;
-  mlfqstr.mlfq_stride = (int)(STRIDE_DIVIDEND/(100-mlfqstr.stride_share) + 0.5);
+static void
+siftdown(struct runq *rq, int i)
+{
+  struct proc *e = rq->sheap[i];
+  int child;
+
+  for(;;){
+    child = 2 * i + 1;
+    if(child >= rq->nsheap)
+      break;
+    if(child + 1 < rq->nsheap &&
+       hpass(rq, rq->sheap[child + 1]) < hpass(rq, rq->sheap[child]))
+      child++;
+    if(hpass(rq, e) <= hpass(rq, rq->sheap[child]))
+      break;
+    hset(rq, i, rq->sheap[child]);
+    i = child;
+  }
+  hset(rq, i, e);
+}
+
+static int
+hidx(struct runq *rq, struct proc *e)
+{
+  return e == MLFQ_ENTRY ? rq->mlfq_hidx : e->hidx;
+}
+
+static void
+heapinsert(struct runq *rq, struct proc *e)
+{
+  if(hidx(rq, e) >= 0)
+    return;
+  hset(rq, rq->nsheap++, e);
+  siftup(rq, rq->nsheap - 1);
+}
+
+static void
+heapremove(struct runq *rq, struct proc *e)
+{
+  int i = hidx(rq, e);
+  struct proc *last;
+
+  if(i < 0)
+    return;
+  if(e == MLFQ_ENTRY)
+    rq->mlfq_hidx = -1;
+  else
+    e->hidx = -1;
+
+  last = rq->sheap[--rq->nsheap];
+  if(i == rq->nsheap)
+    return;
+  hset(rq, i, last);
+  siftup(rq, i);
+  siftdown(rq, hidx(rq, last));
+}
+
+// Re-order e after its pass value grew.
+static void
+heapcharged(struct runq *rq, struct proc *e)
+{
+  int i = hidx(rq, e);
+
+  if(i >= 0)
+    siftdown(rq, i);
+}
+
+// Lag keeps an entry's place in the stride order while it is out of the
+// heap (sleeping, mlfq empty, share changed, moved to another queue).
+// Pass values are 64 bits and only ever grow, so they never wrap; what
+// an entry carries across a leave and a join is its distance from the
+// queue's virtual time, clamped to one tick's worth of stride (the
+// stride argument) either way so that it can
+// neither bank credit by sleeping nor be punished for long for having
+// just run.
+static int
+savelag(struct runq *rq, uint64 pass, int stride)
+{
+  if(pass >= rq->vtime){
+    if(pass - rq->vtime > stride)
+      return stride;
+    return pass - rq->vtime;
+  }
+  if(rq->vtime - pass > stride)
+    return -stride;
+  return -(int)(rq->vtime - pass);
+}
+
+// Pass value of an entry joining rq with the given lag.
+static uint64
+joinpass(struct runq *rq, int lag)
+{
+  if(lag < 0 && rq->vtime < (uint)-lag)
+    return 0;
+  return rq->vtime + lag;
+}
+
+// Advance the virtual time to the least pass in the heap.
+static void
+advancevtime(struct runq *rq)
+{
+  if(rq->nsheap > 0 && hpass(rq, rq->sheap[0]) > rq->vtime)
+    rq->vtime = hpass(rq, rq->sheap[0]);
+}
+
+// The mlfq entry joins and leaves the heap as the mlfq gets processes
+// waiting and runs out of them.
+static void
+mlfqjoin(struct runq *rq)
+{
+  if(rq->mlfq_hidx >= 0)
+    return;
+  rq->mlfq_pass = joinpass(rq, rq->mlfq_lag);
+  heapinsert(rq, MLFQ_ENTRY);
+}
+
+static void
+mlfqleave(struct runq *rq)
+{
+  if(rq->mlfq_hidx < 0)
+    return;
+  rq->mlfq_lag = savelag(rq, rq->mlfq_pass, rq->mlfq_stride * TICKFRAC);
+  heapremove(rq, MLFQ_ENTRY);
+}
 
-  // If the stride queue becomes empty, we reset the mlfq's pass value to 0
-  if(!mlfqstr.stride_head)
-    mlfqstr.mlfq_pass = 0;
-  //cprintf("mlfq share: %d, mlfq stride: %d, mlfq pass: %d\n", 100-mlfqstr.stride_share, mlfqstr.mlfq_stride, mlfqstr.mlfq_pass);
+// Put a runnable process that is off the CPU where scheduler() looks for
+// work: the stride heap, or the tail of its mlfq level list.
+// lock of the process's run queue should be acquired in caller.
+static void
+rqenqueue(struct proc* p)
+{
+  classof(p)->put_prev(&runqs[p->rqid], p);
+}
+
+// Change the share reserved on rq by delta and reset its mlfq stride.
+// lock of the run queue should be acquired in caller.
+static void
+rqshare(struct runq *rq, int delta)
+{
+  rq->stride_share += delta;
+  rq->mlfq_stride = (int)(STRIDE_DIVIDEND/(100-rq->stride_share) + 0.5);
+}
+
+// Remove an exiting process from the stride queue and give its share back.
+// lock of the process's run queue and mlfqstr's lock should be acquired in caller.
+void 
+striderm(struct proc * p)
+{
+  struct runq *rq = &runqs[p->rqid];
+
+  heapremove(rq, p);
+  rq->nstride--;
+
+  // reset the mlfq share and mlfq stride
+  // A share group gives its share back with its last member.
+  if(p->sgroup < 0)
+    mlfqstr.stride_share -= p->share;
+  rqshare(rq, -p->share);
+
+  // With the stride queue empty the mlfq has nothing to compete with.
+  // Its pass is kept, as lag, for the next stride process to arrive.
+  if(rq->nstride == 0)
+    mlfqleave(rq);
 }
 
+// Make the running process p a stride process of its run queue.
+// It enters the heap when it next gives up the CPU runnable.
+// lock of the process's run queue should be acquired in caller.
 void 
 strideadd(struct proc * p)
 {
-  // Add to the front of the stride queue.
-  p->s_link = mlfqstr.stride_head;
-  mlfqstr.stride_head = p;
+  struct runq *rq = &runqs[p->rqid];
+
+  p->hidx = -1;
+  rq->nstride++;
+}
+
+// Move the runnable or running stride process p, out of any heap, to run
+// queue to with a share of share, and give it pass vtime + lag there.
+// locks of both run queues should be acquired in caller.
+static void
+stridemove(struct proc *p, struct runq *to, int share, int lag)
+{
+  struct runq *from = &runqs[p->rqid];
+
+  from->stride_cnt--;
+  from->nstride--;
+  rqshare(from, -p->share);
+
+  p->rqid = to - runqs;
+  strideadd(p);
+  to->stride_cnt++;
+  rqshare(to, share);
+  p->pass = joinpass(to, lag);
+
+  if(from->nstride == 0)
+    mlfqleave(from);
+}
+
+// CPU share, in percent, the group of the main thread p has reserved on
+// its run queue.
+static int
+reserved(struct proc *p)
+{
+  if(p->level == -1)
+    return p->share;
+  if(p->level == EDF_LEVEL)
+    return (p->runtime * 100 + p->period - 1) / p->period;
+  return 0;
+}
+
+// Whether p may run on the CPU of run queue id (set_affinity()).
+static int
+allowed(struct proc *p, int id)
+{
+  return (p->lwpgroup->affinity >> id) & 1;
+}
+
+// Choose the run queue for p to reserve share on: the queue with the
+// least share reserved, stride and EDF together, not counting p's own,
+// among those p may run on, that still has room for it,
+// preferring p's own queue on a tie so that it does not move for nothing.
+// Returns -1 if no queue has room.
+// Reads the queues without their locks; set_cpu_share() checks the
+// choice again once it holds them.
+static int
+placeshare(struct proc *p, int share)
+{
+  struct runq *rq;
+  int res, best = -1, bestres = MAXSHARE + 1;
+
+  for(rq = runqs; rq < &runqs[ncpu]; rq++){
+    if(!allowed(p, rq - runqs))
+      continue;
+    res = rq->stride_share + rq->edf_share;
+    if(rq - runqs == p->rqid)
+      res -= reserved(p);
+    if(res + share > MAXSHARE)
+      continue;
+    if(res < bestres || (res == bestres && rq - runqs == p->rqid)){
+      best = rq - runqs;
+      bestres = res;
+    }
+  }
+  return best;
+}
+
+// Largest stride of a thread, so that a tick's worth of it still fits
+// the int lag (see savelag).
+#define MAXPSTRIDE (0x7fffffff / TICKFRAC)
+
+// Stride of the heap entry of p, a process or thread of a stride group.
+// The group's share is split between its threads by their weights.
+// A light thread among heavy ones in a small group gets MAXPSTRIDE at
+// most, and so a little more than its part.
+// p's group lock should be acquired in caller.
+static uint
+pstride(struct proc *p)
+{
+  uint stride;
+
+  // At most STRIDE_DIVIDEND * NPROC * MAXWEIGHT before the division.
+  stride = (uint)p->lwpgroup->stride * p->lwpgroup->tweights / p->tweight;
+  if(stride > MAXPSTRIDE)
+    return MAXPSTRIDE;
+  return stride;
+}
+
+// Number of processes runnable or running on rq.
+// Idle CPUs read this without the queue lock, so it is only a hint.
+static int
+rqload(struct runq *rq)
+{
+  volatile struct runq *vrq = rq;
+  return vrq->mlfq_proc_cnt + vrq->stride_cnt + vrq->edf_cnt;
+}
+
+static int busiest(struct runq *self);
+static int stridejoin(struct proc *p, int share, int global);
+static int placewarm(struct proc *p);
+static int killproc(struct proc *p, int pid);
+
+// Make sure a CPU notices the work just put on rq: the CPU of rq if it
+// is halted in scheduler(), or else, when rq has more than its CPU can
+// run, any halted CPU, which can steal from it. Halted CPUs also wake up
+// on every timer tick, so this only saves them waiting for one.
+// The caller has made the work visible (released rq's lock) before the
+// idle flags are read here; see idle().
+// Interrupts should be disabled in caller (a spinlock held).
+static void
+rqkick(struct runq *rq)
+{
+  struct cpu *c = &cpus[rq - runqs];
+
+  if(c != mycpu() && c->idle){
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+    return;
+  }
+  if(rqload(rq) < 2)
+    return;
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c != mycpu() && c->idle){
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+      return;
+    }
+  }
+}
+
+// Count p on its run queue when it becomes runnable. If set_affinity()
+// ruled that queue out while p slept, p moves to one it may use first.
+// p's group lock should be acquired in caller.
+void
+runqadd(struct proc* p)
+{
+  struct runq *rq;
+
+  if(!allowed(p, p->rqid))
+    p->rqid = placewarm(p);
+  rq = &runqs[p->rqid];
+  acquire(&rq->lock);
+  classof(p)->enqueue(rq, p);
+  release(&rq->lock);
+  rqkick(rq);
+}
+
+// Stop counting p on its run queue (sleep, exit).
+// p's group lock should be acquired in caller.
+void
+runqrm(struct proc* p)
+{
+  struct runq *rq = &runqs[p->rqid];
+
+  acquire(&rq->lock);
+  classof(p)->dequeue(rq, p);
+  release(&rq->lock);
 }
 
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  struct runq *rq;
+  int i;
+
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->lock, "proc");
+  initlock(&wait_lock, "wait");
+  initlock(&pid_lock, "pid");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
   initlock(&mlfqstr.lock, "mlfqstr");
+  initlock(&sgtable.lock, "sgtable");
   
   // initialize values in mlfqstr
   acquire(&mlfqstr.lock);
-  mlfqstr.priboosttime = 0;
-  mlfqstr.qlevels[0] = mlfqstr.qlevels[1] = mlfqstr.qlevels[2] = 0;
-  mlfqstr.stride_head = NULL;
   mlfqstr.stride_share = 0;
-  mlfqstr.mlfq_pass = 0;
-  mlfqstr.mlfq_stride = 0;
   release(&mlfqstr.lock);
+
+  for(rq = runqs; rq < &runqs[NCPU]; rq++){
+    initlock(&rq->lock, "runq");
+    rq->priboosttime = 0;
+    for(i = 0; i < NMLFQ; i++){
+      rq->qhead[i] = rq->qtail[i] = NULL;
+      rq->qlevels[i] = 0;
+    }
+    memset(rq->wakelat, 0, sizeof(rq->wakelat));
+    rq->ehead = rq->etail = NULL;
+    rq->edf_cnt = 0;
+    rq->edf_share = 0;
+    rq->mlfq_proc_cnt = 0;
+    rq->stride_cnt = 0;
+    rq->nstride = 0;
+    rq->nsheap = 0;
+    rq->mlfq_hidx = -1;
+    rq->stride_share = 0;
+    rq->mlfq_stride = STRIDE_DIVIDEND/100;
+    rq->mlfq_pass = 0;
+    rq->mlfq_lag = 0;
+    rq->vtime = 0;
+  }
 }
 
 // Must be called with interrupts disabled
@@ -149,6 +825,26 @@ myproc(void) {
   return p;
 }
 
+static int
+allocpid(void)
+{
+  int pid;
+
+  acquire(&pid_lock);
+  pid = nextpid++;
+  release(&pid_lock);
+  return pid;
+}
+
+// Give back a slot that was taken from the process table.
+static void
+freeslot(struct proc *p)
+{
+  acquire(&p->lock);
+  p->state = UNUSED;
+  release(&p->lock);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -161,30 +857,48 @@ allocproc(void)
   char *sp;
 
 //  cprintf("allocproc\n");
-  acquire(&ptable.lock);
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
     if(p->state == UNUSED)
       goto found;
-
-  release(&ptable.lock);
+    release(&p->lock);
+  }
   return 0;
 
 found:
   p->state = EMBRYO;
-  p->pid = nextpid++;
+  p->pid = allocpid();
 
-  // Assign to level 2
-  p->level = 2;
-  p->timequant = 5;
-  p->timeallot = 20;
+  // Start at the top level.
+  p->level = toplevel();
+  p->timequant = mlfqparam.quantum[p->level];
+  p->timeallot = mlfqparam.allot[p->level];
   p->tickcount = 0;
   
   // Initialize values needed when added to stride queue.
-  p->s_link = NULL; 
+  p->hidx = -1;
+  p->queued = 0;
   p->share = 0;
   p->stride = -1;
   p->pass = 0;
+  p->lag = 0;
+  p->rqid = 0;
+  p->slice = 0;
+  p->cputime = 0;
+  p->pilevel = 0;
+  p->boosted = 0;
+  p->pipass = 0;
+  p->pilocks = 0;
+  p->cpu = -1;
+  p->lastrun = 0;
+  p->affinity = ~0;
+  p->sgroup = -1;
+  p->weight = 0;
+  p->gcputime = 0;
+  p->tweight = TWEIGHT;
+  p->tweights = TWEIGHT;
+  p->sleepavg = 0;
+  p->wakets = 0;
 
   // Treat the process as the number 0 thread of itself.
   p->thread_count = 1;
@@ -192,13 +906,12 @@ found:
   p->next_tid = 1;
   p->lwpgroup = p;
   //p->caller_isnt_yield = 0;
-  p->waiting_tid = -1;
 
-  release(&ptable.lock);
+  release(&p->lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    freeslot(p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -253,24 +966,25 @@ userinit(void)
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
   cprintf("userinit\n");
-  acquire(&ptable.lock);
+  acquire(&p->lock);
   p->state = RUNNABLE;
-  release(&ptable.lock);
-  
-  acquire(&mlfqstr.lock);
-  mlfqadd(p);
-  release(&mlfqstr.lock);
+  runqadd(p);
+  release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
+// The threads of a process share its page table and may run at the
+// same time, so the size is kept in the main thread and changed under
+// the group lock, which the caller should hold.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
+  struct proc *main_thread = curproc->lwpgroup;
 
-  sz = curproc->sz;
+  sz = main_thread->sz;
   if(n > 0){
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -278,11 +992,84 @@ growproc(int n)
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
+  main_thread->sz = sz;
   curproc->sz = sz;
   switchuvm(curproc);
   return 0;
 }
 
+// Choose the run queue for a new process: the least loaded one of the
+// CPUs in mask, preferring the forking CPU's own queue on a tie.
+// Interrupts should be disabled in caller (a spinlock held).
+static int
+placeproc(uint mask)
+{
+  int i, best = -1, load, bestload = 0;
+
+  if((mask >> cpuid()) & 1){
+    best = cpuid();
+    bestload = rqload(&runqs[best]);
+  }
+  for(i = 0; i < ncpu; i++){
+    if(!((mask >> i) & 1))
+      continue;
+    load = rqload(&runqs[i]);
+    if(best < 0 || load < bestload){
+      best = i;
+      bestload = load;
+    }
+  }
+  return best < 0 ? cpuid() : best;
+}
+
+// Choose the run queue for p, off every queue, to go back to after its
+// queue was ruled out by set_affinity(): that of the CPU it last ran on,
+// whose cache may still hold its data, if allowed, or else the least
+// loaded one it may use.
+// Interrupts should be disabled in caller (a spinlock held).
+static int
+placewarm(struct proc *p)
+{
+  if(p->cpu >= 0 && allowed(p, p->cpu))
+    return p->cpu;
+  return placeproc(p->lwpgroup->affinity);
+}
+
+// Move p, runnable and off every queue and CPU but counted on its run
+// queue, over to run queue id, and queue it there.
+// p's group lock should be acquired in caller.
+static void
+rqmove(struct proc *p, int id)
+{
+  struct schedclass *cls = classof(p);
+  struct runq *rq = &runqs[p->rqid];
+
+  acquire(&rq->lock);
+  cls->dequeue(rq, p);
+  release(&rq->lock);
+  p->rqid = id;
+  rq = &runqs[id];
+  acquire(&rq->lock);
+  cls->enqueue(rq, p);
+  release(&rq->lock);
+  rqkick(rq);
+}
+
+// Make the new thread p runnable: on its group's run queue if the
+// group is a stride or EDF group, whose share is reserved there, or
+// else on the least loaded queue, like a new process.
+// p's group lock should be acquired in caller.
+void
+placethread(struct proc *p)
+{
+  struct proc *main_thread = p->lwpgroup;
+
+  p->rqid = classof(p)->pinned ? main_thread->rqid :
+            placeproc(main_thread->affinity);
+  p->state = RUNNABLE;
+  runqadd(p);
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -303,12 +1090,11 @@ fork(void)
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    freeslot(np);
     return -1;
   }
   np->sz = curproc->sz;
   np->ustack = np->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -324,16 +1110,21 @@ fork(void)
   pid = np->pid;
 
 //  cprintf("fork\n");
-  acquire(&ptable.lock);
+  acquire(&wait_lock);
+  np->parent = curproc;
+  release(&wait_lock);
 
-  np->state = RUNNABLE;
-  if(np->level != -1){
-    acquire(&mlfqstr.lock);
-    mlfqadd(np);
-    release(&mlfqstr.lock);
-  }
+  // A member of a share group is placed with its part of the share.
+  np->affinity = curproc->lwpgroup->affinity;
+  if(curproc->lwpgroup->sgroup >= 0)
+    sgjoin(np, curproc->lwpgroup->sgroup, curproc->lwpgroup->weight);
 
-  release(&ptable.lock);
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  if(np->sgroup < 0)
+    np->rqid = placeproc(np->affinity);
+  runqadd(np);
+  release(&np->lock);
 
   return pid;
 }
@@ -351,6 +1142,19 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  // A thread that exits takes its whole process with it: its main
+  // thread is killed, and stops the other threads when it exits.
+  // A thread killed that way only exits itself.
+  if(curproc->pid == -1){
+    if(!curproc->killed)
+      killproc(curproc->lwpgroup, curproc->lwpgroup->pid);
+    thread_exit(0);
+  }
+
+  // The other threads share the address space: stop them first.
+  stopthreads();
+  sgleave(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -364,41 +1168,82 @@ exit(void)
   end_op();
   curproc->cwd = 0;
 
-  acquire(&ptable.lock);
+  acquire(&wait_lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
+  // A child turns ZOMBIE holding wait_lock, so its state can be read here.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
   // Jump into the scheduler, never to return.
+  // The parent can only free this process once it holds the lock,
+  // which is after scheduler() has switched away from it.
+  acquire(&curproc->lock);
   curproc->state = ZOMBIE;
-  // Remove from mflq
-  if(curproc->level != -1){
-    acquire(&mlfqstr.lock);
-    mlfqrm(curproc);
-    release(&mlfqstr.lock);
-  }
-  // Remove from stride queue
-  else{
+  release(&wait_lock);
+  // Remove from its run queue, and give back the share it reserved.
+  runqrm(curproc);
+  if(classof(curproc)->leave){
+    acquire(&runqs[curproc->rqid].lock);
     acquire(&mlfqstr.lock);
-    striderm(curproc);
+    classof(curproc)->leave(&runqs[curproc->rqid], curproc);
     release(&mlfqstr.lock);
+    release(&runqs[curproc->rqid].lock);
   }
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
+// Stop and free all the other threads of the calling main thread,
+// before it exits or replaces its address space. Each of them is
+// killed and woken up, and exits (see exit()) the next time it is
+// about to return to user space.
+void
+stopthreads(void)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  int live;
+
+  // Threads turn ZOMBIE and are freed holding wait_lock.
+  acquire(&wait_lock);
+  for(;;){
+    live = 0;
+    // Only this process creates and frees its threads while it runs
+    // here, so its threads stay in their slots.
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p == curproc || p->lwpgroup != curproc || p->state == UNUSED)
+        continue;
+      if(p->state != ZOMBIE){
+        live = 1;
+        killproc(p, -1);
+      }
+    }
+    if(!live)
+      break;
+    // Woken up by thread_exit().
+    sleep(curproc, &wait_lock);
+  }
+
+  acquire(&curproc->lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p != curproc && p->lwpgroup == curproc && p->state == ZOMBIE)
+      thread_free(p);
+  release(&curproc->lock);
+  release(&wait_lock);
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
 wait(void)
 {
   struct proc *p;
@@ -406,7 +1251,7 @@ wait(void)
   struct proc *curproc = myproc();
   
  
-  acquire(&ptable.lock);
+  acquire(&wait_lock);
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
@@ -414,6 +1259,8 @@ wait(void)
       if(p->parent != curproc)
         continue;
       havekids = 1;
+      // A child is a main thread, so its own lock is its group lock.
+      acquire(&p->lock);
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
@@ -425,27 +1272,169 @@ wait(void)
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
-        release(&ptable.lock);
+        release(&p->lock);
+        release(&wait_lock);
         return pid;
       }
+      release(&p->lock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || curproc->killed){
-      release(&ptable.lock);
+      release(&wait_lock);
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
+    sleep(curproc, &wait_lock);  //DOC: wait-sleep
+  }
+}
+
+// Find the run queue an idle CPU should take work from: the queue with
+// the most processes waiting behind the one running there.
+// Reads the queues without their locks, so the answer is only a hint.
+static int
+busiest(struct runq *self)
+{
+  volatile struct runq *rq;
+  int ready, maxready = 0, victim = -1;
+
+  for(rq = runqs; rq < &runqs[ncpu]; rq++){
+    if(rq == self || rqload((struct runq*)rq) < 2)
+      continue;
+    ready = mlfqready((struct runq*)rq) + rq->nsheap - (rq->mlfq_hidx >= 0);
+    if(ready > maxready){
+      maxready = ready;
+      victim = (struct runq*)rq - runqs;
+    }
+  }
+  return victim;
+}
+
+// Whether p last ran so recently that its data is likely still in the
+// cache of its CPU, and so is better left to wait there a little.
+#define CACHEHOT 1  // ticks
+
+static int
+cachehot(struct proc *p)
+{
+  return ticks - p->lastrun < CACHEHOT;
+}
+
+// Move the highest level waiting mlfq process or thread of victim onto
+// self or, if there is none, a waiting stride process whose share self
+// has room for. Only processes allowed on self's CPU and not cache hot
+// are taken. The stride process carries its lag over to self's
+// virtual time. Stride groups with threads stay where their share is.
+// A waiting process is RUNNABLE and off every CPU, so nobody else
+// touches its queue fields or rqid while both queues are locked.
+// Returns 1 if a process was moved.
+static int
+steal(struct runq *self, struct runq *victim)
+{
+  struct proc *p = NULL;
+  struct runq *first, *second;
+  int level, i, lag;
+
+  first = self < victim ? self : victim;
+  second = self < victim ? victim : self;
+  acquire(&first->lock);
+  acquire(&second->lock);
+
+  for(level = NMLFQ - 1; level >= 0 && !p; level--){
+    for(p = victim->qhead[level]; p; p = p->q_next)
+      if(p->state == RUNNABLE && allowed(p, self - runqs) && !cachehot(p))
+        break;
+  }
+
+  if(p){
+    mlfqrm(p);
+    p->rqid = self - runqs;
+    mlfqadd(p);
+  }
+  else{
+    for(i = 0; i < victim->nsheap; i++){
+      p = victim->sheap[i];
+      if(p != MLFQ_ENTRY && p->pid != -1 && p->thread_count == 1 &&
+         allowed(p, self - runqs) && !cachehot(p) &&
+         self->stride_share + self->edf_share + p->share <= MAXSHARE)
+        break;
+      p = NULL;
+    }
+    if(p){
+      lag = savelag(victim, p->pass, p->stride * TICKFRAC);
+      heapremove(victim, p);
+      stridemove(p, self, p->share, lag);
+      heapinsert(self, p);
+    }
   }
+
+  release(&second->lock);
+  release(&first->lock);
+  return p != NULL;
+}
+
+// Choose the next process to run from rq and take it off its queue:
+// the first one a scheduling class has, in class order.
+// rq's lock should be acquired in caller.
+static struct proc*
+pickproc(struct runq *rq)
+{
+  struct schedclass **c;
+  struct proc *newproc;
+
+  for(c = sclasses; *c; c++)
+    if((newproc = (*c)->pick_next(rq)) != NULL)
+      return newproc;
+  return NULL;
+}
+
+// Halt this CPU until an interrupt comes in: the next timer tick, or a
+// wakeup IPI from rqkick() when work shows up. The idle flag is raised
+// before the queues are looked at one last time, and rqkick() reads it
+// after queueing the work, so that either this CPU sees the work here or
+// it gets the IPI. sti;hlt only lets interrupts in once halted.
+// Other queues are not looked at if steal is 0: what waits there could
+// not be taken (affinity, cache hot), and will be tried again next tick.
+// stuck is how many of rq's processes cannot run before the next tick
+// (throttled EDF groups); only more than that is work.
+static void
+idle(struct cpu *c, struct runq *rq, int steal, int stuck)
+{
+  cli();
+  xchg(&c->idle, 1);
+  if(rqload(rq) <= stuck && (!steal || busiest(rq) < 0))
+    asm volatile("sti; hlt");
+  c->idle = 0;
+}
+
+// Add the time p waited from its wakeup until now, when it is about to
+// run, to rq's histograms. Bucket 0 counts waits under 1/TICKFRAC of a
+// tick and bucket i those under 2^i of them, the last bucket the rest.
+static void
+wakelatency(struct runq *rq, struct proc *p)
+{
+  uint64 d = p->tscstart - p->wakets;
+  uint units;
+  int i;
+
+  p->wakets = 0;
+  if(tsc_per_unit == 0)
+    return;
+  if(d > 0xffffffff)
+    d = 0xffffffff;
+  units = (uint)d / tsc_per_unit;
+  for(i = 0; units && i < NWAKELAT - 1; i++)
+    units >>= 1;
+  rq->wakelat[p->wakeio][i]++;
 }
 
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose a process to run from this CPU's run queue,
+//    taking one from the busiest queue if ours is empty
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
@@ -453,108 +1442,117 @@ void
 scheduler(void)
 {
   struct cpu * c = mycpu();
-  struct proc * searchidx = ptable.proc;
+  struct runq * rq = &runqs[c - cpus];
+  struct proc * newproc = NULL;
+  struct spinlock * glk;
+  pde_t * pgdir;
+  int victim, stuck = 0;
   c->proc = 0;
-  //int caller_isnt_yield;
 
   for(;;){
     // Enable interrupts on this processor
     sti();
 
-
-    acquire(&ptable.lock);
-
-    struct proc * newproc = NULL;
-
-    acquire(&mlfqstr.lock);
-    // If the stride queue is not empty
-    if(mlfqstr.stride_head){
-      // Find the process with the least pass value
-      uint min_pass;
-      struct proc* sp = mlfqstr.stride_head;
-
-      if(mlfqstr.mlfq_proc_cnt > 0){
-        min_pass = mlfqstr.mlfq_pass;
-      }
-      else{
-        min_pass = mlfqstr.stride_head->pass;
+    // newproc may already be picked, at the end of the last round.
+    if(!newproc){
+      // Peek at the queues without any lock first, so that an idle CPU
+      // does not keep pulling queue locks away from the busy ones.
+      // The stuck processes left on rq by the last pick, throttled EDF
+      // groups, do not count until the next tick.
+      victim = -1;
+      if(rqload(rq) <= stuck && (victim = busiest(rq)) < 0){
+        idle(c, rq, 1, stuck);
+        stuck = 0;
+        continue;
       }
 
-      while(sp){
-        if(sp->pass <= min_pass && sp->state == RUNNABLE){
-          min_pass = sp->pass;
-          newproc = sp;
-        }
-        sp = sp->s_link;
+      if(victim >= 0 && !steal(rq, &runqs[victim]) && rqload(rq) <= stuck){
+        idle(c, rq, 0, stuck);
+        stuck = 0;
+        continue;
       }
 
-      // if a stride process has the smallest pass value
-      if(newproc){
-        release(&mlfqstr.lock);
-        goto contextswitch;
-      }
+      acquire(&rq->lock);
+      newproc = pickproc(rq);
+      stuck = newproc ? 0 : rqload(rq);
+      release(&rq->lock);
+
+      if(!newproc)
+        continue;
     }
 
-    // Search process to run from mlfq.
-    // First, find the level to select from.
-    int level;
-    if (mlfqstr.qlevels[2] > 0) level = 2;
-    else if (mlfqstr.qlevels[1] > 0) level = 1;
-    else level = 0;
-    release(&mlfqstr.lock);
+    // Off the queue, newproc is ours to run. Its group lock comes after
+    // the queue locks, so it is only taken now. The group, and so the
+    // lock, stays as long as newproc has not been freed, which takes
+    // the lock.
+    glk = &newproc->lwpgroup->lock;
+    acquire(glk);
+    switchuvm(newproc);
 
-    // Search the ptable for a runnable process, from the mlfq, with the correct level.
-    // A process in the stride queue wont be selected because their level values are -1
-    
-    // We search at most 64 processes (loop through the entire ptable)
-    // before giving up and ending the search.
-    int cnt = 0;
-    struct proc* p;
-    while((p = searchidx)){
-      if(searchidx < &ptable.proc[NPROC-1])
-        searchidx ++;
-      else
-        searchidx = ptable.proc;
-
-      if((p->state == RUNNABLE) && (p->level == level) && (p->pid!=-1)){
-        newproc = p;
-        goto contextswitch;
+    // A new time quantum starts for the process or thread.
+    newproc->slice = 0;
+
+    // Run newproc and then, as long as the next one picked is another
+    // thread of its group, that one without going back to the kernel
+    // page table: the threads share the user one, so only the kernel
+    // stack in the TSS changes and the TLB is kept. The page table
+    // cannot be freed while the group lock is held, as exit() and
+    // exec() stop every other thread of the group first, which takes it.
+    for(;;){
+      c->proc = newproc;
+      newproc->state = RUNNING;
+      newproc->cpu = c - cpus;
+      newproc->tscstart = rdtsc();
+      if(newproc->wakets)
+        wakelatency(rq, newproc);
+     
+      swtch(&(c->scheduler), newproc->context);
+      
+      c->proc = 0;
+      newproc->lastrun = ticks;
+
+      // A process that gave up the CPU still runnable (yield) goes back to
+      // the stride heap with its new pass, or to the tail of its level list,
+      // which by now reflects any level change.
+      // It may have moved to another queue while it ran (set_cpu_share()),
+      // or set_affinity() may have ruled this one out.
+      if(newproc->state == RUNNABLE && !allowed(newproc, newproc->rqid))
+        rqmove(newproc, placeproc(newproc->lwpgroup->affinity));
+      else if(newproc->state == RUNNABLE){
+        acquire(&runqs[newproc->rqid].lock);
+        rqenqueue(newproc);
+        release(&runqs[newproc->rqid].lock);
+        if(&runqs[newproc->rqid] != rq)
+          rqkick(&runqs[newproc->rqid]);
       }
 
-      if(cnt >= 63) 
-        break;
-      cnt++;
-    }
+      // A thread handed the CPU by yield_to() is already off the
+      // queues, and keeps the quantum it was given.
+      if(c->handoff){
+        newproc = c->handoff;
+        c->handoff = 0;
+        switchkstack(newproc);
+        continue;
+      }
 
-    if(!newproc){
-      goto norunnable;
-    }
-    
-contextswitch:
-    // If this process is a main thread of a lwp group with mutiple threads 
-    if(newproc->thread_count > 1){
-      thread_swtch(&(c->scheduler), newproc);
-      switchkvm();
-      c->proc = 0;
-      goto norunnable;
+      pgdir = newproc->pgdir;
+      acquire(&rq->lock);
+      newproc = pickproc(rq);
+      release(&rq->lock);
+      if(!newproc || &newproc->lwpgroup->lock != glk || newproc->pgdir != pgdir)
+        break;
+      newproc->slice = 0;
+      switchkstack(newproc);
     }
 
-    c->proc = newproc;
-    switchuvm(newproc);
-    newproc->state = RUNNING;
-   
-    swtch(&(c->scheduler), newproc->context);
-    
     switchkvm();
-    c->proc = 0;
-
-norunnable:
-    release(&ptable.lock);
+    c->pgdir = 0;
+    release(glk);
   }
 }
 
-// Enter scheduler.  Must hold only pable.lock
-// and have changed proc->state. Saves and restores
+// Enter scheduler.  Must hold only the lock of
+// the process's group and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -566,15 +1564,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(p->pid==-1){
-    //cprintf("a thread called sched\n");
-    //if(readeflags()&FL_IF)
-   //   cprintf("interrupt enabled\n");
-   // cprintf("p->context: 0x%x\n", &p->context);
-  }
-
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lwpgroup->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -586,294 +1577,1137 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Boost every waiting mlfq process and thread of rq to the top level.
+// Only the other level lists are walked, so this is O(runnable). Their
+// groups cannot be locked here, after the queue lock, so the threads
+// move to the top list marked boosted, which keeps them there (see
+// qpush()), and each group goes up with its first boosted thread to be
+// charged for CPU time, under the group lock (see mlfq_tick()).
+// rq's lock should be acquired in caller.
 void
-priboost(){
-  struct proc* p;
-  for(p=ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == RUNNABLE && p->level != -1 && p->pid!=-1){ //pid==-1 means this is a thread.
-      mlfqstr.qlevels[p->level]--;
-      p->level = 2;
-      p->timequant = 5;
-      p->timeallot = 20;
-      p->tickcount = 0;
-      mlfqstr.qlevels[2]++;
+priboost(struct runq *rq){
+  uint level, top = toplevel();
+  struct proc *p;
+
+  for(level = 0; level < NMLFQ; level++){
+    while(level != top && (p = rq->qhead[level]) != 0){
+      qunlink(p);
+      p->boosted = 1;
+      qpush(p);
     }
   }
 }
 
+// Boost the run queue of this CPU every mlfqparam.boost ticks, and the
+// process running here with it, as it is off the lists. Called from
+// the timer interrupt of each CPU.
+// ticks is read without tickslock, as the boost period is coarse.
+void
+mlfqboost(void)
+{
+  struct runq *rq = &runqs[cpuid()];
+  struct proc *p = myproc();
+
+  if(ticks - rq->priboosttime < mlfqparam.boost)
+    return;
+  acquire(&rq->lock);
+  rq->priboosttime = ticks;
+  priboost(rq);
+  if(p && p->state == RUNNING && &runqs[p->rqid] == rq &&
+     classof(p) == &mlfqclass)
+    p->boosted = 1;
+  release(&rq->lock);
+}
+
+// Lower the level of p's group.
 void lowerlevel(struct proc* p){
-  if (p->level < 1 || p->level > 2){
+  uint level = p->lwpgroup->level;
+
+  if (level < 1 || level >= NMLFQ){
     return;
   }
 
-  // no need to acquire mlfqstr's lock. (done in yield)
-  mlfqstr.qlevels[p->level]--;
-  
-  p->level--;
-  p->tickcount = 0;
-  switch(p->level){
-    case 1:
-      p->timequant = 10;
-      p->timeallot = 40;
-      break;
-    case 0:
-      p->timequant = 20;
-      break;
-  }
-  
-  mlfqstr.qlevels[p->level]++;
+  // no need to acquire the run queue's lock. (done in yield)
+  setlevel(p, level - 1);
 }
 
-int
-thread_swtch(struct context** old_context, struct proc* main_thread)
+//PAGEBREAK!
+// The mlfq class.
+// Waiting processes are on the list of their group's level; the whole
+// mlfq runs as one entry of the stride heap when there is stride work.
+
+static void
+mlfq_enqueue(struct runq *rq, struct proc *p)
 {
-  struct proc* next_t;
-  acquire(&mlfqstr.lock);
-  next_t = mlfqstr.next_t[main_thread->pid];
-  update_next_t(main_thread);
-  release(&mlfqstr.lock);
-  
-  if(!next_t){
-    return -1;
-  }
+  mlfqadd(p);
+}
 
-  /*if(next_t->waiting_tid != -1 || next_t->state != RUNNABLE){
-    next_t = mlfqstr.next_t[main_thread->pid];
-    update_next_t(main_thread);
-  }*/
+static void
+mlfq_dequeue(struct runq *rq, struct proc *p)
+{
+  mlfqrm(p);
+}
 
-  if(next_t == myproc()){
-    //cprintf("trying to switch to itself, tid:%d\n", myproc()->thread_id);
-    myproc()->state = RUNNING;
-    return 0;
-  }
+// The head of the highest level list that is not empty.
+static struct proc*
+mlfq_pick_next(struct runq *rq)
+{
+  struct proc *p;
+  int level;
 
-  mycpu()->proc = next_t;
-  switchuvm(next_t);
-  next_t->state = RUNNING;
-  //cprintf("thread switch to tid %d\n", next_t->thread_id);
-  swtch(old_context, next_t->context);
-  return 0;
+  for(level = NMLFQ - 1; level >= 0 && rq->qlevels[level] == 0; level--)
+    ;
+  if(level < 0)
+    return NULL;
+
+  p = rq->qhead[level];
+  qunlink(p);
+  return p;
 }
 
-// Give up the CPU for one scheduling round.
-int
-yield(void)
+static void
+mlfq_put_prev(struct runq *rq, struct proc *p)
 {
-  /*if(myproc()->lwpgroup->thread_count > 1){
-    cprintf("thread %d yield\n", myproc()->thread_id);
-  }*/
-  acquire(&ptable.lock);  //DOC: yieldlock
+  qpush(p);
+}
 
-  struct proc* curproc = myproc();
-  struct proc* main_thread = curproc->lwpgroup;
-  
-  uint tickcount = main_thread->tickcount++;
-  uint level = main_thread->level;
-  uint timeallot = main_thread->timeallot;
-  
-  curproc->state = RUNNABLE;
+static int
+mlfq_take(struct runq *rq, struct proc *p)
+{
+  if(!p->queued)
+    return 0;
+  qunlink(p);
+  return 1;
+}
 
-  // Check if this process has used up its time allotment
-  // We skip this part for stride processes (their level values are -1)
-  int lowered = 0;
-  if(level > 0 && (tickcount >= timeallot)){
-    // used up its time allot
-    lowerlevel(main_thread);
-    lowered = 1;
-  }
-  
-  // Priority Boost
-  acquire(&tickslock);
-  acquire(&mlfqstr.lock);
-  if(ticks - mlfqstr.priboosttime >= 200){
-    mlfqstr.priboosttime = ticks;
-    priboost();
-  }
-  release(&tickslock);
-
-  // If the stride queue is not empty, we have to increment pass values every time a process yields
-  if(mlfqstr.stride_head){
-    // if the yielding process is in the stride queue
-    if(level == -1)
-      main_thread->pass += main_thread->stride;
-        
-    // if the yielding process is in the mlfq
-    else 
-      mlfqstr.mlfq_pass += mlfqstr.mlfq_stride;
-  }
-  release(&mlfqstr.lock);
+// The time goes to the queue's mlfq pass, if there is stride work to
+// compete with, and to the time allotment of p's group, so that a group
+// goes down the levels as fast as all its threads together use the CPU.
+// Returns 1 if the group used up its allotment and was lowered.
+static int
+mlfq_tick(struct runq *rq, struct proc *p, uint units)
+{
+  struct proc *main_thread = p->lwpgroup;
 
-  // If the process has mutiple threads,
-  // we choose the next thread to run here and context switch.
-  // We do not context switch through the scheduler.
-  if(main_thread->thread_count > 1){
-    //procdump();
-    if(thread_swtch(&curproc->context, main_thread) == -1){
-      sched();
-    }
+  if(rq->nstride > 0){
+    rq->mlfq_pass += (uint64)rq->mlfq_stride * units;
+    heapcharged(rq, MLFQ_ENTRY);
   }
 
-  // Do not call scheduler if it hasn't used up its time quantum
-  // Processes in stride queue will always call the scheduler because their time quantum is 1.
-  else if(lowered || tickcount % main_thread->timequant == 0){
-    sched();
+  // Boosted by its queue (see priboost()), or left above the top level
+  // by a smaller level count.
+  if(p->boosted || main_thread->level > toplevel()){
+    p->boosted = 0;
+    setlevel(p, toplevel());
   }
 
-  release(&ptable.lock);
-
+  main_thread->tickcount += units;
+  main_thread->sleepavg -= units < main_thread->sleepavg ? units : main_thread->sleepavg;
+  if(main_thread->level > 0 &&
+     main_thread->tickcount >= main_thread->timeallot * TICKFRAC){
+    lowerlevel(p);
+    return 1;
+  }
   return 0;
 }
 
-// A fork child's very first scheduling by scheduler()
-// will swtch here.  "Return" to user space.
-void
-forkret(void)
+// The quantum is measured like the allotment, and counts as used up
+// within half a tick so that timer jitter does not cost a whole tick.
+// A thread's quantum is its part, by weight, of one quantum for each
+// thread of its group; equal weights leave it the group's quantum.
+static int
+mlfq_yield(struct runq *rq, struct proc *p)
 {
-  static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
-
-  if (first) {
-    // Some initialization functions must be run in the context
-    // of a regular process (e.g., they call sleep), and thus cannot
-    // be run from main().
-    first = 0;
-    iinit(ROOTDEV);
-    initlog(ROOTDEV);
-  }
+  struct proc *g = p->lwpgroup;
 
-  // Return to "caller", actually trapret (see allocproc).
+  return p->slice + TICKFRAC/2 >=
+         g->timequant * TICKFRAC * g->thread_count * p->tweight / g->tweights;
 }
 
-// Atomically release lock and sleep on chan.
-// Reacquires lock when awakened.
-void
-sleep(void *chan, struct spinlock *lk)
+// A mlfq waiter lends its group's level; any other waiter, the top one.
+static void
+mlfq_lend(struct runq *rq, struct proc *p, struct proc *waiter)
 {
-  struct proc *p = myproc();
-  
-  if(p == 0)
-    panic("sleep");
-
-  if(lk == 0)
-    panic("sleep without lk");
-
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
-  p->chan = chan;
-  p->state = SLEEPING;
-  if(p->level != -1){
-    acquire(&mlfqstr.lock);
-    mlfqrm(p);
-    release(&mlfqstr.lock);
-  }
+  uint level = toplevel();
 
-  /*if(p->pid == -1){
-    cprintf("thread %d sleep\n", p->thread_id);
-  }*/
+  if(classof(waiter) == &mlfqclass)
+    level = waiter->lwpgroup->level;
+  if(level > p->pilevel)
+    p->pilevel = level;
+}
 
-  sched();
+static struct schedclass mlfqclass = {
+  .name = "mlfq",
+  .pinned = 0,
+  .enqueue = mlfq_enqueue,
+  .dequeue = mlfq_dequeue,
+  .pick_next = mlfq_pick_next,
+  .put_prev = mlfq_put_prev,
+  .take = mlfq_take,
+  .tick = mlfq_tick,
+  .yield = mlfq_yield,
+  .lend = mlfq_lend,
+};
+
+// The stride class.
+// Waiting processes are in the stride heap, ordered by pass, together
+// with the mlfq entry.
 
-  // Tidy up.
-  p->chan = 0;
+static void
+stride_enqueue(struct runq *rq, struct proc *p)
+{
+  rq->stride_cnt++;
+  p->pass = joinpass(rq, p->lag);
+  heapinsert(rq, p);
+}
 
-  // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+static void
+stride_dequeue(struct runq *rq, struct proc *p)
+{
+  rq->stride_cnt--;
+  p->lag = savelag(rq, p->pass, pstride(p) * TICKFRAC);
+  heapremove(rq, p);
 }
 
-void 
-wakeup_one(void* chan)
+// The heap entry with the least pass, unless that is the mlfq entry,
+// in which case the mlfq class picks.
+static struct proc*
+stride_pick_next(struct runq *rq)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == SLEEPING && p->chan == chan){
-      p->state = RUNNABLE;
-      break;
-    }
-  }
+  if(rq->nstride == 0)
+    return NULL;
+
+  // The mlfq entry is in the heap only while mlfq processes are waiting.
+  if(mlfqready(rq) > 0)
+    mlfqjoin(rq);
+  else
+    mlfqleave(rq);
+  advancevtime(rq);
+
+  if(rq->nsheap == 0 || rq->sheap[0] == MLFQ_ENTRY)
+    return NULL;
+  p = rq->sheap[0];
+  heapremove(rq, p);
+  return p;
 }
 
-//PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
 static void
-wakeup1(void *chan)
+stride_put_prev(struct runq *rq, struct proc *p)
 {
-  struct proc *p;
+  heapinsert(rq, p);
+}
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == SLEEPING && p->chan == chan){
-      p->state = RUNNABLE;
-      if(p->level != -1){
-        acquire(&mlfqstr.lock);
-        mlfqadd(p);
-        release(&mlfqstr.lock);
-      }
-    }
-  }
+static int
+stride_take(struct runq *rq, struct proc *p)
+{
+  if(p->hidx < 0)
+    return 0;
+  heapremove(rq, p);
+  return 1;
 }
 
-// Wake up all processes sleeping on chan.
-void
-wakeup(void *chan)
+static int
+stride_tick(struct runq *rq, struct proc *p, uint units)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  p->pass += (uint64)pstride(p) * units;
+  if(p->pipass)
+    p->pipass += (uint64)pstride(p) * units;
+  heapcharged(rq, p);
+  return 0;
 }
 
-// Kill the process with the given pid.
-// Process won't exit until it returns
-// to user space (see trap in trap.c).
-int
-kill(int pid)
+// The time quantum of a stride process is one tick.
+static int
+stride_yield(struct runq *rq, struct proc *p)
 {
-  struct proc *p;
+  return 1;
+}
 
-  cprintf("kill\n");
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING){
-        p->state = RUNNABLE;
-        if(p->level != -1){
-          acquire(&mlfqstr.lock);
-          mlfqadd(p);
-          release(&mlfqstr.lock);
-        }
-      }
-      release(&ptable.lock);
-      return 0;
-    }
-  }
-  release(&ptable.lock);
-  return -1;
+// mlfqstr's lock should be acquired in caller, too.
+static void
+stride_leave(struct runq *rq, struct proc *p)
+{
+  striderm(p);
 }
 
-//PAGEBREAK: 36
-// Print a process listing to console.  For debugging.
-// Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
-void
-procdump(void)
+// A stride waiter on the same queue lends its pass. Passes of other
+// queues do not compare, so any other waiter lends the queue's virtual
+// time, which puts p at the front. The lent pass is charged like p's
+// own while p runs.
+static void
+stride_lend(struct runq *rq, struct proc *p, struct proc *waiter)
 {
-  static char *states[] = {
+  uint64 pass = rq->vtime;
+
+  if(classof(waiter) == &strideclass && waiter->rqid == p->rqid &&
+     waiter->pass < pass)
+    pass = waiter->pass;
+  if(p->pipass == 0 || pass < p->pipass)
+    p->pipass = pass;
+}
+
+static struct schedclass strideclass = {
+  .name = "stride",
+  .pinned = 1,
+  .enqueue = stride_enqueue,
+  .dequeue = stride_dequeue,
+  .pick_next = stride_pick_next,
+  .put_prev = stride_put_prev,
+  .take = stride_take,
+  .tick = stride_tick,
+  .yield = stride_yield,
+  .leave = stride_leave,
+  .lend = stride_lend,
+};
+
+// The EDF class.
+// An EDF group gets up to runtime ticks of CPU time in every period,
+// its budget, and runs ahead of everything else, the earliest deadline
+// first, as long as it has budget left. Out of budget, it is throttled
+// until its deadline, when a new period starts. A group that wakes up
+// after its deadline starts a new period then, so that it cannot use
+// up budget left over from long ago in a burst.
+// Waiting EDF processes are on an unordered list, linked like the mlfq
+// lists, and looked through for the earliest deadline: there are only
+// ever a few of them. The EDF fields of a group are guarded by the lock
+// of its run queue, where all its threads stay.
+
+static void
+edfreplenish(struct proc *g)
+{
+  g->deadline = ticks + g->period;
+  g->budget = g->runtime * TICKFRAC;
+}
+
+static void
+edfpush(struct runq *rq, struct proc *p)
+{
+  p->q_next = NULL;
+  p->q_prev = rq->etail;
+  if(rq->etail)
+    rq->etail->q_next = p;
+  else
+    rq->ehead = p;
+  rq->etail = p;
+  p->queued = 1;
+}
+
+static void
+edfunlink(struct runq *rq, struct proc *p)
+{
+  if(p->q_prev)
+    p->q_prev->q_next = p->q_next;
+  else
+    rq->ehead = p->q_next;
+  if(p->q_next)
+    p->q_next->q_prev = p->q_prev;
+  else
+    rq->etail = p->q_prev;
+  p->q_next = p->q_prev = NULL;
+  p->queued = 0;
+}
+
+// The waiting EDF process with the earliest deadline that is not
+// throttled, or 0. Starts the new period of throttled groups whose
+// deadline has passed.
+static struct proc*
+edfpeek(struct runq *rq)
+{
+  struct proc *p, *g, *best = NULL;
+
+  for(p = rq->ehead; p; p = p->q_next){
+    g = p->lwpgroup;
+    if(g->budget <= 0){
+      if((int)(ticks - g->deadline) < 0)
+        continue;
+      edfreplenish(g);
+    }
+    if(!best || (int)(g->deadline - best->lwpgroup->deadline) < 0)
+      best = p;
+  }
+  return best;
+}
+
+static void
+edf_enqueue(struct runq *rq, struct proc *p)
+{
+  struct proc *g = p->lwpgroup;
+
+  rq->edf_cnt++;
+  if((int)(ticks - g->deadline) >= 0)
+    edfreplenish(g);
+  edfpush(rq, p);
+}
+
+static void
+edf_dequeue(struct runq *rq, struct proc *p)
+{
+  rq->edf_cnt--;
+  if(p->queued)
+    edfunlink(rq, p);
+}
+
+static struct proc*
+edf_pick_next(struct runq *rq)
+{
+  struct proc *p;
+
+  if((p = edfpeek(rq)) != NULL)
+    edfunlink(rq, p);
+  return p;
+}
+
+static void
+edf_put_prev(struct runq *rq, struct proc *p)
+{
+  edfpush(rq, p);
+}
+
+static int
+edf_take(struct runq *rq, struct proc *p)
+{
+  if(!p->queued)
+    return 0;
+  edfunlink(rq, p);
+  return 1;
+}
+
+// Returns 1 once the group ran out of budget.
+static int
+edf_tick(struct runq *rq, struct proc *p, uint units)
+{
+  struct proc *g = p->lwpgroup;
+
+  g->budget -= units;
+  return g->budget <= 0;
+}
+
+// Keeps the CPU while it has budget and no earlier deadline is waiting.
+static int
+edf_yield(struct runq *rq, struct proc *p)
+{
+  struct proc *g = p->lwpgroup;
+  struct proc *next;
+
+  if(g->budget <= 0)
+    return 1;
+  next = edfpeek(rq);
+  return next && (int)(next->lwpgroup->deadline - g->deadline) < 0;
+}
+
+static int
+edf_preempt(struct runq *rq)
+{
+  return edfpeek(rq) != NULL;
+}
+
+static void
+edf_leave(struct runq *rq, struct proc *p)
+{
+  rq->edf_share -= reserved(p);
+}
+
+static struct schedclass edfclass = {
+  .name = "edf",
+  .pinned = 1,
+  .enqueue = edf_enqueue,
+  .dequeue = edf_dequeue,
+  .pick_next = edf_pick_next,
+  .put_prev = edf_put_prev,
+  .take = edf_take,
+  .tick = edf_tick,
+  .yield = edf_yield,
+  .preempt = edf_preempt,
+  .leave = edf_leave,
+};
+
+// Charge the running process p, a thread or not, for the CPU time it used
+// since it was switched in or last charged. Time is read from the TSC and
+// counted in 1/TICKFRAC of a tick, so a process is charged for what it
+// really ran, not for the ticks that happened to find it running; before
+// the TSC rate is measured, fallback units are charged instead.
+// The time goes to p's own cputime and quantum, and then to whatever
+// the class of p charges for it (see the tick hooks).
+// Returns 1 if p has to give up the CPU now: its mlfq group used up its
+// time allotment and was lowered, or its EDF group ran out of budget.
+// p's group lock and lock of p's run queue should be acquired in caller.
+static int
+account(struct proc* p, uint fallback)
+{
+  struct runq* rq = &runqs[p->rqid];
+  uint64 now = rdtsc();
+  uint units;
+
+  if(tsc_per_unit == 0){
+    units = fallback;
+    p->tscstart = now;
+  }
+  else{
+    // Runs longer than 2^32 cycles only happen with interrupts off for
+    // that long; cap them so the rest stays in 32-bit arithmetic.
+    if(now - p->tscstart > 0xffffffff)
+      p->tscstart = now - 0xffffffff;
+    units = (uint)(now - p->tscstart) / tsc_per_unit;
+    // Leave the part of a unit not charged yet for the next time.
+    p->tscstart += (uint64)units * tsc_per_unit;
+  }
+  if(units == 0)
+    return 0;
+
+  p->cputime += units;
+  p->slice += units;
+  p->lwpgroup->gcputime += units;
+
+  return classof(p)->tick(rq, p, units);
+}
+
+// Give up the CPU for one scheduling round.
+int
+yield(void)
+{
+  struct proc* curproc = myproc();
+  struct proc* main_thread = curproc->lwpgroup;
+  struct schedclass *cls, **c;
+  int preempt;
+
+  acquire(&main_thread->lock);  //DOC: yieldlock
+
+  struct runq* rq = &runqs[curproc->rqid];
+  cls = classof(curproc);
+  
+  curproc->state = RUNNABLE;
+
+  acquire(&rq->lock);
+
+  // Charge the time used since the last yield. Before the TSC rate is
+  // known, a yield stands for one tick, as the timer caused it.
+  // This also lowers the level of a process that used up its time
+  // allotment, or throttles one out of EDF budget.
+  preempt = account(curproc, TICKFRAC);
+  
+  // Do not call scheduler if its class lets it keep the CPU (its time
+  // quantum is not used up), unless a class above has work waiting.
+  if(!preempt)
+    preempt = cls->yield(rq, curproc);
+  for(c = sclasses; !preempt && *c != cls; c++)
+    if((*c)->preempt)
+      preempt = (*c)->preempt(rq);
+  release(&rq->lock);
+
+  if(preempt){
+    sched();
+  }
+
+  // Keep running: a RUNNABLE process could otherwise be picked up,
+  // or stolen, by another CPU while it is still running here.
+  else{
+    curproc->state = RUNNING;
+  }
+
+  release(&main_thread->lock);
+
+  return 0;
+}
+
+// Hand the CPU to thread tid of the caller's LWP group (0 for the main
+// thread) right away, ahead of the run queue order, and give it what is
+// left of the caller's time quantum. The caller goes back on its queue
+// as after yield(). Only a thread waiting on a run queue can be handed
+// the CPU: returns -1 if tid is the caller or not in its group, or if
+// it is sleeping, running, or being switched in by another CPU, or if
+// its affinity rules out the caller's CPU.
+int
+yield_to(int tid)
+{
+  struct proc *curproc = myproc();
+  struct proc *main_thread = curproc->lwpgroup;
+  struct runq *rq = &runqs[curproc->rqid];
+  struct schedclass *cls = classof(curproc);
+  struct runq *prq;
+  struct proc *p;
+
+  acquire(&main_thread->lock);
+  for(p = main_thread; p; p = p->t_link)
+    if(p->thread_id == tid)
+      break;
+  if(!p || p == curproc || p->state != RUNNABLE ||
+     !allowed(p, curproc->rqid)){
+    release(&main_thread->lock);
+    return -1;
+  }
+
+  // Take p off its queue, unless a scheduler has picked it already.
+  // A mlfq thread moves over to the caller's queue to run here; the
+  // threads of a pinned group all live on the same queue. steal() may
+  // move p until its queue is locked.
+  for(;;){
+    prq = &runqs[p->rqid];
+    acquire(&prq->lock);
+    if(prq == &runqs[p->rqid])
+      break;
+    release(&prq->lock);
+  }
+  if(!cls->take(prq, p)){
+    release(&prq->lock);
+    release(&main_thread->lock);
+    return -1;
+  }
+  if(!cls->pinned && prq != rq){
+    cls->dequeue(prq, p);
+    release(&prq->lock);
+    acquire(&rq->lock);
+    p->rqid = curproc->rqid;
+    cls->enqueue(rq, p);
+    cls->take(rq, p);
+  }
+  else{
+    release(&prq->lock);
+    acquire(&rq->lock);
+  }
+  // Charge the caller up to now; the rest of its quantum goes to p.
+  account(curproc, 0);
+  release(&rq->lock);
+
+  p->slice = curproc->slice;
+  mycpu()->handoff = p;
+  curproc->state = RUNNABLE;
+  sched();
+  release(&main_thread->lock);
+  return 0;
+}
+
+// Set the weight of thread tid of the caller's group, 0 being the main
+// thread, from 1 to MAXWEIGHT. The threads of a group get its CPU time
+// in proportion to their weights: those of a stride group its share,
+// through their strides (see pstride), and those of a mlfq group its
+// quanta (see mlfq_yield). The threads of an EDF group share its budget
+// as they come.
+int
+thread_setprio(int tid, int weight)
+{
+  struct proc *main_thread = myproc()->lwpgroup;
+  struct proc *p;
+
+  if(weight < 1 || weight > MAXWEIGHT)
+    return -1;
+  acquire(&main_thread->lock);
+  for(p = main_thread; p; p = p->t_link)
+    if(p->thread_id == tid)
+      break;
+  if(!p){
+    release(&main_thread->lock);
+    return -1;
+  }
+  main_thread->tweights += weight - p->tweight;
+  p->tweight = weight;
+  release(&main_thread->lock);
+  return 0;
+}
+
+// The thread of group g whose user stack holds address sp, or 0.
+// g's lock should be acquired in caller.
+static struct proc*
+stackthread(struct proc *g, uint sp)
+{
+  struct proc *p;
+
+  for(p = g; p; p = p->t_link)
+    if(p->ustack - PGSIZE <= sp && sp < p->ustack)
+      return p;
+  return 0;
+}
+
+// Whether the thread of the caller's group whose user stack holds
+// address sp is on a CPU: 1 if it is, 0 if not, -1 if no thread's stack
+// holds sp. A hint for user mutexes on whether to spin for a holder
+// (see mutex_lock() in ulib.c), out of date as soon as it is returned.
+int
+thread_running(uint sp)
+{
+  struct proc *main_thread = myproc()->lwpgroup;
+  struct proc *p;
+  int r = -1;
+
+  acquire(&main_thread->lock);
+  if((p = stackthread(main_thread, sp)) != 0)
+    r = p->state == RUNNING;
+  release(&main_thread->lock);
+  return r;
+}
+
+
+// Priority inheritance.
+// A process about to wait for a sleeplock held by another process, or a
+// thread for a semaphore in user memory held by another of its group
+// (see futex_wait()), lends its priority to the holder, in the terms
+// of the holder's class (see the lend hooks): a mlfq holder waits on the
+// list of a higher level, a stride holder with a lower pass. An EDF
+// holder needs nothing. The holder keeps what it was lent until it has
+// released every lock it took (pilocks), as a waiter for an outer lock
+// may still be waiting then. Lending is not passed on along chains of
+// holders.
+
+static void lendto(struct proc*);
+static void unlend(struct proc*);
+static void pidrop(struct proc*);
+
+// Lend the priority of the calling process to p, which holds a lock the
+// caller is about to wait for.
+// The lock's own spinlock may be held in caller.
+void
+pilend(struct proc *p)
+{
+  struct proc *g;
+
+  if(p == 0 || p == myproc() || (g = p->lwpgroup) == 0)
+    return;
+  acquire(&g->lock);
+  if(p->lwpgroup == g && p->state != UNUSED && p->state != EMBRYO &&
+     p->state != ZOMBIE)
+    lendto(p);
+  release(&g->lock);
+}
+
+// Lend the priority of the calling process to p. p may be waiting, and
+// moved by steal() until its queue is locked.
+// p's group lock should be acquired in caller.
+static void
+lendto(struct proc *p)
+{
+  struct schedclass *cls;
+  struct runq *rq;
+  int queued;
+
+  cls = classof(p);
+  if(cls->lend){
+    for(;;){
+      rq = &runqs[p->rqid];
+      acquire(&rq->lock);
+      if(rq == &runqs[p->rqid])
+        break;
+      release(&rq->lock);
+    }
+    queued = cls->take(rq, p);
+    cls->lend(rq, p, myproc());
+    if(queued)
+      cls->put_prev(rq, p);
+    release(&rq->lock);
+  }
+}
+
+// p took a lock that waiters lend their priority for.
+void
+piacquire(struct proc *p)
+{
+  acquire(&p->lwpgroup->lock);
+  p->pilocks++;
+  release(&p->lwpgroup->lock);
+}
+
+// p released a lock taken with piacquire(). Once it holds none, it gives
+// back what it was lent.
+void
+pirelease(struct proc *p)
+{
+  struct proc *g = p->lwpgroup;
+
+  if(g == 0)
+    return;
+  acquire(&g->lock);
+  if(p->lwpgroup == g)
+    unlend(p);
+  release(&g->lock);
+}
+
+// Count one lock less for p, and give back what it was lent if that
+// was the last one.
+// p's group lock should be acquired in caller.
+static void
+unlend(struct proc *p)
+{
+  if(p->pilocks <= 0 || --p->pilocks > 0)
+    return;
+  pidrop(p);
+}
+
+// p gives back what it was lent. As in lendto(), p's queue is only
+// known once it is locked.
+// p's group lock should be acquired in caller.
+static void
+pidrop(struct proc *p)
+{
+  struct schedclass *cls;
+  struct runq *rq;
+  int queued;
+
+  if(p->pilevel || p->pipass){
+    cls = classof(p);
+    for(;;){
+      rq = &runqs[p->rqid];
+      acquire(&rq->lock);
+      if(rq == &runqs[p->rqid])
+        break;
+      release(&rq->lock);
+    }
+    queued = cls->take(rq, p);
+    p->pilevel = 0;
+    p->pipass = 0;
+    if(queued)
+      cls->put_prev(rq, p);
+    release(&rq->lock);
+  }
+}
+
+// Locks in user memory name their holder by an address on its stack,
+// which a thread knows without a system call (see ulib.c), and which
+// the process can set to anything. So the holder is only looked for
+// among the threads of the caller's own group, and a process cannot
+// lend to, or take back from, any other. The kernel does not count
+// these locks: a holder gives back what it was lent when it releases
+// one that was waited for, unless it holds sleeplocks, which then give
+// it back with their last.
+
+// pilend() for the thread of the caller's group whose stack holds sp.
+void
+pilendsp(uint sp)
+{
+  struct proc *g = myproc()->lwpgroup;
+  struct proc *p;
+
+  acquire(&g->lock);
+  if((p = stackthread(g, sp)) != 0 && p != myproc() && p->state != UNUSED &&
+     p->state != EMBRYO && p->state != ZOMBIE)
+    lendto(p);
+  release(&g->lock);
+}
+
+// Give back what the thread of the caller's group whose stack holds sp
+// was lent, if it holds no sleeplocks.
+void
+pireleasesp(uint sp)
+{
+  struct proc *g = myproc()->lwpgroup;
+  struct proc *p;
+
+  acquire(&g->lock);
+  if((p = stackthread(g, sp)) != 0 && p->pilocks == 0)
+    pidrop(p);
+  release(&g->lock);
+}
+
+// A fork child's very first scheduling by scheduler()
+// will swtch here.  "Return" to user space.
+void
+forkret(void)
+{
+  static int first = 1;
+  // Still holding the group lock from scheduler().
+  release(&myproc()->lwpgroup->lock);
+
+  if (first) {
+    // Some initialization functions must be run in the context
+    // of a regular process (e.g., they call sleep), and thus cannot
+    // be run from main().
+    first = 0;
+    iinit(ROOTDEV);
+    initlog(ROOTDEV);
+  }
+
+  // Return to "caller", actually trapret (see allocproc).
+}
+
+// Atomically release lock and sleep on chan, unless timer t,
+// if any, has gone off already. Reacquires lock when awakened.
+static void
+sleep1(void *chan, struct spinlock *lk, struct timer *t)
+{
+  struct proc *p = myproc();
+  
+  if(p == 0)
+    panic("sleep");
+
+  if(lk == 0)
+    panic("sleep without lk");
+
+  // Must acquire the wait queue of chan and the group lock in order
+  // to change p->state and then call sched.
+  // Once we hold them, we can be
+  // guaranteed that we won't miss any wakeup
+  // (wakeup locks both to wake p up),
+  // so it's okay to release lk.
+  struct waitq *wq = waitqof(chan);
+  struct spinlock *glk = &p->lwpgroup->lock;
+  acquire(&wq->lock);
+  // The timer sets fired before it looks for p on wq.
+  if(t && t->fired){
+    release(&wq->lock);
+    return;
+  }
+  if(lk != glk){  //DOC: sleeplock0
+    acquire(glk);  //DOC: sleeplock1
+    release(lk);
+  }
+  // Charge the time used so far first: a process that sleeps just
+  // before the timer fires is charged all the same.
+  acquire(&runqs[p->rqid].lock);
+  account(p, 0);
+  release(&runqs[p->rqid].lock);
+
+  // Go to sleep.
+  p->chan = chan;
+  p->state = SLEEPING;
+  wqpush(wq, p);
+  release(&wq->lock);
+  runqrm(p);
+
+  sched();
+
+  // Tidy up.
+  p->chan = 0;
+
+  // Reacquire original lock.
+  if(lk != glk){  //DOC: sleeplock2
+    release(glk);
+    acquire(lk);
+  }
+}
+
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
+void
+sleep(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 0);
+}
+
+// Interactivity.
+// A mlfq group keeps a sleep average, sleepavg: the time its threads
+// slept waiting for the disk or the console (see wakeup_io()) less the
+// CPU time they used, from 0 to MAXSLEEPAVG, in 1/TICKFRAC ticks. A
+// wakeup from I/O gives the group back as much of the time it used at
+// its level as it slept, and moves it up a level once its sleep average
+// is over half of MAXSLEEPAVG, which costs it that half. So a process
+// that mostly waits for I/O keeps a high level between boosts, however
+// many short bursts it runs in.
+#define MAXSLEEPAVG (10 * TICKFRAC)
+
+// p, sleeping, is being made runnable; io if by a wakeup from I/O.
+// p's group lock should be acquired in caller.
+static void
+woken(struct proc *p, int io)
+{
+  struct proc *g = p->lwpgroup;
+  uint64 now = rdtsc();
+  uint slept;
+
+  p->wakets = now;
+  p->wakeio = io;
+  if(!io || tsc_per_unit == 0 || classof(p) != &mlfqclass)
+    return;
+
+  // p was last charged when it went to sleep.
+  if(now - p->tscstart >= (uint64)MAXSLEEPAVG * tsc_per_unit)
+    slept = MAXSLEEPAVG;
+  else
+    slept = (uint)(now - p->tscstart) / tsc_per_unit;
+  g->tickcount -= slept < g->tickcount ? slept : g->tickcount;
+  g->sleepavg += slept;
+  if(g->sleepavg > MAXSLEEPAVG)
+    g->sleepavg = MAXSLEEPAVG;
+  if(g->sleepavg > MAXSLEEPAVG/2 && g->level < toplevel()){
+    g->sleepavg -= MAXSLEEPAVG/2;
+    setlevel(p, g->level + 1);
+  }
+}
+
+// A timed sleep. Its timer wakes p if p still sleeps on chan.
+struct sleeptimer {
+  struct timer t;
+  struct proc *p;
+  void *chan;
+};
+
+static void
+sleepexpire(struct timer *t)
+{
+  struct sleeptimer *st = (struct sleeptimer*)t;
+  struct waitq *wq = waitqof(st->chan);
+  struct proc *p = st->p;
+
+  // p cannot leave sleep_timeout() while its timer runs.
+  acquire(&wq->lock);
+  acquire(&p->lwpgroup->lock);
+  if(p->state == SLEEPING && p->chan == st->chan){
+    wqunlink(wq, p);
+    p->state = RUNNABLE;
+    woken(p, 0);
+    runqadd(p);
+  }
+  release(&p->lwpgroup->lock);
+  release(&wq->lock);
+}
+
+// Like sleep(), but wake up after n ticks at the latest.
+// Returns -1 if the time ran out, 0 otherwise.
+int
+sleep_timeout(void *chan, struct spinlock *lk, int n)
+{
+  struct sleeptimer st;
+
+  if(myproc() == 0)
+    panic("sleep_timeout");
+  st.t.slot = 0;
+  st.t.fn = sleepexpire;
+  st.p = myproc();
+  st.chan = chan;
+  timerstart(&st.t, n);
+  sleep1(chan, lk, &st.t);
+  timerstop(&st.t);
+  return st.t.fired ? -1 : 0;
+}
+
+// Take p, sleeping on wq, off it and make it runnable.
+// Caller holds wq->lock; a process on a wait queue is SLEEPING,
+// so its group cannot go away under us.
+static void
+wakeproc(struct waitq *wq, struct proc *p, int io)
+{
+  struct proc *g = p->lwpgroup;
+
+  acquire(&g->lock);
+  wqunlink(wq, p);
+  p->state = RUNNABLE;
+  woken(p, io);
+  runqadd(p);
+  release(&g->lock);
+}
+
+// Wake up at most n processes sleeping on chan, those that have
+// been waiting longest. Returns how many were woken up.
+int
+wakeup_n(void *chan, int n)
+{
+  struct waitq *wq = waitqof(chan);
+  struct proc *p, *next;
+  int woken = 0;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p && woken < n; p = next){
+    next = p->w_next;
+    if(p->chan == chan){
+      wakeproc(wq, p, 0);
+      woken++;
+    }
+  }
+  release(&wq->lock);
+  return woken;
+}
+
+// Wake up one process sleeping on chan, the one that
+// has been waiting longest.
+void 
+wakeup_one(void* chan)
+{
+  wakeup_n(chan, 1);
+}
+
+static void
+wakeall(void *chan, int io)
+{
+  struct waitq *wq = waitqof(chan);
+  struct proc *p, *next;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = next){
+    next = p->w_next;
+    if(p->chan == chan)
+      wakeproc(wq, p, io);
+  }
+  release(&wq->lock);
+}
+
+//PAGEBREAK!
+// Wake up all processes sleeping on chan.
+// No group lock should be held in caller.
+void
+wakeup(void *chan)
+{
+  wakeall(chan, 0);
+}
+
+// Like wakeup(), for a device driver waking up processes that waited
+// for I/O to complete: credits their interactivity (see woken()).
+void
+wakeup_io(void *chan)
+{
+  wakeall(chan, 1);
+}
+
+// Set the killed flag of p, if its pid is still pid, and wake it up
+// if it sleeps, so that it notices. Returns -1 if p is not pid any more.
+static int
+killproc(struct proc *p, int pid)
+{
+  struct spinlock *glk = &p->lwpgroup->lock;
+  struct waitq *wq;
+  void *chan;
+
+  acquire(glk);
+  if(p->pid != pid || p->state == UNUSED){
+    release(glk);
+    return -1;
+  }
+  p->killed = 1;
+  // Wake process from sleep if necessary. Its wait queue comes
+  // before its lock, so look up the channel first and recheck.
+  while(p->state == SLEEPING){
+    chan = p->chan;
+    release(glk);
+    wq = waitqof(chan);
+    acquire(&wq->lock);
+    acquire(glk);
+    if(p->state == SLEEPING && p->chan == chan){
+      wqunlink(wq, p);
+      p->state = RUNNABLE;
+      woken(p, 0);
+      runqadd(p);
+    }
+    release(&wq->lock);
+  }
+  release(glk);
+  return 0;
+}
+
+// Kill the process with the given pid.
+// Process won't exit until it returns
+// to user space (see trap in trap.c).
+int
+kill(int pid)
+{
+  struct proc *p;
+
+  cprintf("kill\n");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    // Threads (pid -1) are not killed on their own; a process with
+    // a pid is a main thread, so its group lock is its own.
+    if(p->pid != pid || pid <= 0 || p->lwpgroup != p)
+      continue;
+    if(killproc(p, pid) == 0)
+      return 0;
+  }
+  return -1;
+}
+
+//PAGEBREAK: 36
+// Print a process listing to console.  For debugging.
+// Runs when user types ^P on console.
+// No lock to avoid wedging a stuck machine further.
+void
+procdump(void)
+{
+  static char *states[] = {
   [UNUSED]    "unused",
   [EMBRYO]    "embryo",
   [SLEEPING]  "sleep ",
@@ -893,7 +2727,8 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s level%d", p->pid, state, p->name, p->level);
+    cprintf("%d %s %s level%d rq%d", p->pid, state, p->name,
+            p->lwpgroup ? p->lwpgroup->level : p->level, p->rqid);
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
@@ -905,192 +2740,657 @@ procdump(void)
 
 int 
 getlev(void){
-  int level = myproc()->level;
-  if (level < 0 || level > 2)
+  int level = myproc()->lwpgroup->level;
+  if (level < 0 || level >= NMLFQ)
     return -1;
   else
     return level;
 }
 
+// Set the number of mlfq levels, the time quantum and allotment of each
+// level and the priority boost period. Every run queue is boosted right
+// away, so that waiting groups start over at the new top level.
+int
+mlfq_setparam(struct mlfqparam *mp)
+{
+  struct runq *rq;
+  int i;
+
+  if(mp->nlevel < 1 || mp->nlevel > NMLFQ || mp->boost < 1)
+    return -1;
+  for(i = 0; i < mp->nlevel; i++){
+    if(mp->quantum[i] < 1 || mp->quantum[i] > MLFQ_MAXQUANTUM)
+      return -1;
+    if(i > 0 && (mp->allot[i] < 1 || mp->allot[i] > MLFQ_MAXALLOT))
+      return -1;
+  }
+
+  acquire(&mlfqstr.lock);
+  mlfqparam.nlevel = mp->nlevel;
+  for(i = 0; i < NMLFQ; i++){
+    mlfqparam.quantum[i] = i < mp->nlevel ? mp->quantum[i] : 0;
+    mlfqparam.allot[i] = i > 0 && i < mp->nlevel ? mp->allot[i] : 0;
+  }
+  mlfqparam.boost = mp->boost;
+  release(&mlfqstr.lock);
+
+  for(rq = runqs; rq < &runqs[ncpu]; rq++){
+    acquire(&rq->lock);
+    rq->priboosttime = ticks;
+    priboost(rq);
+    release(&rq->lock);
+  }
+  return 0;
+}
+
+// Copy out the mlfq parameters.
+void
+mlfq_getparam(struct mlfqparam *mp)
+{
+  acquire(&mlfqstr.lock);
+  *mp = mlfqparam;
+  release(&mlfqstr.lock);
+}
+
+// Sum the wakeup latency histograms of all CPUs, of wakeups from I/O if
+// io is 1 and of the others if 0, into hist[NWAKELAT]. The counts are
+// read without the CPUs' schedulers stopping, so they may be a little
+// behind.
+int
+wakelat(int io, uint *hist)
+{
+  struct runq *rq;
+  int i;
+
+  if(io != 0 && io != 1)
+    return -1;
+  for(i = 0; i < NWAKELAT; i++){
+    hist[i] = 0;
+    for(rq = runqs; rq < &runqs[ncpu]; rq++)
+      hist[i] += ((volatile struct runq*)rq)->wakelat[io][i];
+  }
+  return 0;
+}
+
+// CPU time used by the calling process, its threads included,
+// in 1/TICKFRAC of a tick.
+int
+getcputime(void)
+{
+  struct proc *main_thread = myproc()->lwpgroup;
+  struct proc *p;
+  uint time = 0;
+
+  acquire(&main_thread->lock);
+  // Charge the caller for the time up to now.
+  acquire(&runqs[myproc()->rqid].lock);
+  account(myproc(), 0);
+  release(&runqs[myproc()->rqid].lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->lwpgroup == main_thread && p->state != UNUSED)
+      time += p->cputime;
+  release(&main_thread->lock);
+  return time;
+}
+
 int 
 set_cpu_share(int share)
 {
-  acquire(&ptable.lock);
-  acquire(&mlfqstr.lock);
+  struct proc * p = myproc();
 
-  // 0 -> wrong input error
-  if(share <= 0)
+  // 0 or more than one CPU can give -> wrong input error
+  if(share <= 0 || share > MAXSHARE)
     return -1;
 
-  // Total requeste CPU share > 80 -> error
-  if(mlfqstr.stride_share + share > 80)
+  // The share belongs to the whole group, and is only set while the
+  // group has no other threads, which could be waiting on any queue.
+  if(p->pid == -1)
     return -1;
 
+  // A member of a share group gets its share from the group.
+  if(p->sgroup >= 0)
+    return -1;
 
-  struct proc * p = myproc();
-  
-  // if stride queue is empty
-  if(!mlfqstr.stride_head){
-    // remove the process from mlfq
-    mlfqrm(p);
+  return stridejoin(p, share, 1);
+}
+
+// Make p, the calling main thread, a stride process with share on the
+// run queue placeshare() picks, or give it a new share if it is one
+// already. If global, the share counts against the total of all stride
+// shares; the members of a share group count with their group instead.
+static int
+stridejoin(struct proc *p, int share, int global)
+{
+  struct runq * from, * to, * first, * second;
+  int id, lag;
 
-    // add the process to stride queue
-    mlfqstr.stride_head = p;
+  // An EDF process has its CPU time reserved already.
+  acquire(&p->lock);
+  if(p->thread_count > 1 || p->level == EDF_LEVEL){
+    release(&p->lock);
+    return -1;
   }
-  else{
-    struct proc* pptr = mlfqstr.stride_head;
-    while(pptr){
-      if(pptr->pid == p->pid)
-        break;
-      pptr = pptr->s_link;
+
+  // Shares of other queues may change under us until their locks are
+  // held, so the choice is checked again then, and made again if needed.
+  for(;;){
+    // Total requeste CPU share > MAXSHARE on every CPU -> error
+    // A process already in the stride queue gives its old share back first.
+    // Even below that, the share has to fit on a single CPU.
+    if((global && mlfqstr.stride_share - p->share + share > MAXSHARE * ncpu) ||
+       (id = placeshare(p, share)) < 0){
+      release(&p->lock);
+      return -1;
     }
 
-    // This process was not already in stride queue -> currently in mlfq
-    if(!pptr){
-      // Remove from mlfq
-      mlfqrm(p);
+    from = &runqs[p->rqid];
+    to = &runqs[id];
+    first = from < to ? from : to;
+    second = from < to ? to : from;
+    acquire(&first->lock);
+    if(second != first)
+      acquire(&second->lock);
+    acquire(&mlfqstr.lock);
 
-      // Add to the stride queue
-      strideadd(p);
-    }
+    if((!global || mlfqstr.stride_share - p->share + share <= MAXSHARE * ncpu) &&
+       to->stride_share + to->edf_share - (to == from ? reserved(p) : 0) + share <= MAXSHARE)
+      break;
 
-    // If this process is already in the stride queue, we don't have to worry about it.
-    // Since the stride_head contains pointers to the proc structs, we simply change the values of myproc().
+    release(&mlfqstr.lock);
+    if(second != first)
+      release(&second->lock);
+    release(&first->lock);
   }
 
-  mlfqstr.stride_share += share;
-  p->share = share;
-
   int stride = (int)(STRIDE_DIVIDEND/share + 0.5); // round up
+
+  // This process was not already in stride queue -> currently in mlfq
+  if(p->level != -1){
+    // Remove from mlfq
+    mlfqrm(p);
+
+    // Add to the stride queue of the chosen run queue.
+    // It starts at the queue's virtual time, not at pass 0,
+    // which would let it monopolize the cpu for its first runs.
+    p->rqid = id;
+    strideadd(p);
+    to->stride_cnt++;
+    rqshare(to, share);
+    p->pass = to->vtime;
+  }
+
+  // If this process is already in the stride queue, it keeps its place:
+  // its lag is rescaled to the new stride, in 32-bit arithmetic.
+  else{
+    lag = savelag(from, p->pass, p->stride * TICKFRAC) / p->stride * stride;
+    stridemove(p, to, share, lag);
+  }
+
+  // Running, so on no heap: it joins the heap of its new queue when it
+  // yields, and the CPU of that queue picks it up from there.
+  if(global)
+    mlfqstr.stride_share += share - p->share;
+  p->share = share;
   p->stride = stride; 
   
   p->level = -1;
   p->timequant = 5;
-  
-  // Pass value is already set to 0 in allocproc.
-  // If the process is already in the stride queue, we don't update pass to 0
-  // because it would monopolize the cpu for the first few runs.
-  
-  mlfqstr.mlfq_stride = (int)(STRIDE_DIVIDEND/(100-mlfqstr.stride_share) + 0.5);
 
-  release(&ptable.lock);
   release(&mlfqstr.lock);
+  if(second != first)
+    release(&second->lock);
+  release(&first->lock);
+  release(&p->lock);
   return 0; 
 }
 
-struct proc* 
-find_unused(void){
-  struct proc* p;
+// Make the calling process an EDF process that gets runtime ticks of CPU
+// time in every period ticks, ahead of stride and mlfq processes, and
+// start its first period. An EDF process may call it again to change
+// both. The bandwidth, rounded up to a percent, is reserved on one run
+// queue next to the stride shares there, and the call fails if no queue
+// has room for it within MAXSHARE. Like set_cpu_share(), only for a
+// process without threads, and not for a stride process.
+int
+set_deadline(int runtime, int period)
+{
+  struct proc *p = myproc();
+  struct runq *from, *to, *first, *second;
+  int share, id;
 
-  acquire(&ptable.lock);
-  
-  for(p=ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED){
-      release(&ptable.lock);
-      return p;
+  if(runtime <= 0 || period <= 0 || period > EDF_MAXPERIOD || runtime > period)
+    return -1;
+  share = (runtime * 100 + period - 1) / period;
+  if(share > MAXSHARE || p->pid == -1)
+    return -1;
+
+  acquire(&p->lock);
+  if(p->thread_count > 1 || p->level == -1){
+    release(&p->lock);
+    return -1;
+  }
+
+  // As in set_cpu_share(), the choice is checked again under the locks.
+  for(;;){
+    if((id = placeshare(p, share)) < 0){
+      release(&p->lock);
+      return -1;
     }
+    from = &runqs[p->rqid];
+    to = &runqs[id];
+    first = from < to ? from : to;
+    second = from < to ? to : from;
+    acquire(&first->lock);
+    if(second != first)
+      acquire(&second->lock);
+
+    if(to->stride_share + to->edf_share - (to == from ? reserved(p) : 0) + share <= MAXSHARE)
+      break;
+
+    if(second != first)
+      release(&second->lock);
+    release(&first->lock);
   }
- 
-  release(&ptable.lock);
-  return NULL;
+
+  // Running, so on no queue: only the counts move.
+  if(p->level == EDF_LEVEL){
+    from->edf_cnt--;
+    from->edf_share -= reserved(p);
+  }
+  else
+    mlfqrm(p);
+  p->rqid = id;
+  to->edf_cnt++;
+  to->edf_share += share;
+
+  p->level = EDF_LEVEL;
+  p->runtime = runtime;
+  p->period = period;
+  edfreplenish(p);
+
+  if(second != first)
+    release(&second->lock);
+  release(&first->lock);
+  release(&p->lock);
+  return 0;
 }
 
-struct proc* 
-find_thread(int tid, int gid)
+// Part of the share of group g for a member of weight w.
+// sgtable.lock should be acquired in caller.
+static int
+sgpart(struct sgroup *g, int w)
 {
-  struct proc* p;
+  int share = g->share * w / g->weight;
 
-  acquire(&ptable.lock);
-  
-  for(p=ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->thread_id == tid && p->lwpgroup->pid==gid){
-      release(&ptable.lock);
-      return p;
-    }
+  if(share < 1)
+    return 1;
+  if(share > MAXSHARE)
+    return MAXSHARE;
+  return share;
+}
+
+// Give the stride process p share, or as much of it as its run queue
+// has room for. p may be running, or waiting, and moved by steal()
+// until its queue is locked. A share of 0 gives p's part back for good,
+// for a member leaving its group: p keeps its stride until it is off
+// the queue.
+static void
+sgresize(struct proc *p, int share)
+{
+  struct runq *rq;
+  int room;
+
+  acquire(&p->lock);
+  for(;;){
+    rq = &runqs[p->rqid];
+    acquire(&rq->lock);
+    if(rq == &runqs[p->rqid])
+      break;
+    release(&rq->lock);
   }
- 
-  release(&ptable.lock);
-  return NULL;
+  room = MAXSHARE - rq->stride_share - rq->edf_share + p->share;
+  if(share > room)
+    share = room;
+  if(share != p->share){
+    rqshare(rq, share - p->share);
+    p->share = share;
+    if(share > 0)
+      p->stride = (int)(STRIDE_DIVIDEND/share + 0.5);
+  }
+  release(&rq->lock);
+  release(&p->lock);
+}
+
+// Work out the parts of all the members of group gid again.
+// sgtable.lock should be acquired in caller.
+static void
+sgbalance(int gid)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->sgroup == gid && p->weight > 0 && p->lwpgroup == p)
+      sgresize(p, sgpart(&sgtable.g[gid], p->weight));
+}
+
+// Put np, a fork child not runnable yet, in share group gid with weight
+// w. If no run queue has room for its part, np stays a mlfq process.
+void
+sgjoin(struct proc *np, int gid, int w)
+{
+  struct sgroup *g = &sgtable.g[gid];
+  struct runq *rq = 0;
+  int share, id;
+
+  acquire(&sgtable.lock);
+  if(g->share == 0 || w <= 0){
+    release(&sgtable.lock);
+    return;
+  }
+  // Make room first.
+  g->weight += w;
+  sgbalance(gid);
+  share = sgpart(g, w);
+  for(;;){
+    if((id = placeshare(np, share)) < 0)
+      break;
+    rq = &runqs[id];
+    acquire(&rq->lock);
+    if(rq->stride_share + rq->edf_share + share <= MAXSHARE)
+      break;
+    release(&rq->lock);
+  }
+  if(id < 0){
+    g->weight -= w;
+    sgbalance(gid);
+    release(&sgtable.lock);
+    return;
+  }
+
+  // Counted on the queue once runqadd() makes it runnable.
+  np->rqid = id;
+  strideadd(np);
+  rqshare(rq, share);
+  np->share = share;
+  np->stride = (int)(STRIDE_DIVIDEND/share + 0.5);
+  np->level = -1;
+  np->timequant = 5;
+  np->sgroup = gid;
+  np->weight = w;
+  release(&rq->lock);
+  release(&sgtable.lock);
+}
+
+// Take the exiting main thread p out of its share group. Its part on
+// its run queue goes back right away rather than when it is off the
+// queue, so that the others' parts can grow into it now: nothing would
+// work them out again later. With the last member the group's share
+// goes back too.
+void
+sgleave(struct proc *p)
+{
+  struct sgroup *g;
 
+  if(p->sgroup < 0)
+    return;
+  acquire(&sgtable.lock);
+  g = &sgtable.g[p->sgroup];
+  g->weight -= p->weight;
+  g->cputime += p->gcputime;
+  p->weight = 0;
+  sgresize(p, 0);
+  if(g->weight == 0){
+    acquire(&mlfqstr.lock);
+    mlfqstr.stride_share -= g->share;
+    release(&mlfqstr.lock);
+    g->share = 0;
+  }
+  else
+    sgbalance(p->sgroup);
+  release(&sgtable.lock);
 }
 
-void init_next_t(struct proc* p, int pid)
+// Create a share group with share percent of a CPU, up to MAXSHARE for
+// every CPU, and put the caller in it with weight 1. Only for a mlfq
+// process without threads. Returns the group's id, or -1.
+int
+sgroup_create(int share)
 {
-  //cprintf("init_next_t\n");
+  struct proc *p = myproc();
+  struct sgroup *g;
+  int gid, ok;
+
+  if(share <= 0 || share > MAXSHARE * ncpu || p->pid == -1)
+    return -1;
+
+  acquire(&sgtable.lock);
+  for(gid = 0; gid < NSGROUP && sgtable.g[gid].share; gid++)
+    ;
+  acquire(&p->lock);
+  ok = gid < NSGROUP && p->thread_count == 1 && p->level < NMLFQ && p->sgroup < 0;
+  release(&p->lock);
+  if(!ok){
+    release(&sgtable.lock);
+    return -1;
+  }
+
   acquire(&mlfqstr.lock);
-  mlfqstr.next_t[pid] = p;
+  ok = mlfqstr.stride_share + share <= MAXSHARE * ncpu;
+  if(ok)
+    mlfqstr.stride_share += share;
   release(&mlfqstr.lock);
+  if(!ok){
+    release(&sgtable.lock);
+    return -1;
+  }
+
+  g = &sgtable.g[gid];
+  g->share = share;
+  g->weight = 1;
+  g->cputime = 0;
+  if(stridejoin(p, sgpart(g, 1), 0) < 0){
+    acquire(&mlfqstr.lock);
+    mlfqstr.stride_share -= share;
+    release(&mlfqstr.lock);
+    g->share = 0;
+    release(&sgtable.lock);
+    return -1;
+  }
+  p->sgroup = gid;
+  p->weight = 1;
+  release(&sgtable.lock);
+  return gid;
 }
 
-// mlfqstr.lock should be acquire before calling this function.
+// Set the caller's weight in its share group, from 1 to MAXWEIGHT.
 int
-update_next_t(struct proc* main_t)
+sgroup_weight(int weight)
 {
-  if(!main_t){
-    cprintf("main_t is null\n");
+  struct proc *p = myproc()->lwpgroup;
+  struct sgroup *g;
+
+  if(weight < 1 || weight > MAXWEIGHT)
+    return -1;
+  acquire(&sgtable.lock);
+  if(p->sgroup < 0){
+    release(&sgtable.lock);
+    return -1;
   }
+  g = &sgtable.g[p->sgroup];
+  g->weight += weight - p->weight;
+  p->weight = weight;
+  sgbalance(p->sgroup);
+  release(&sgtable.lock);
+  return 0;
+}
 
-  struct proc* old_t = mlfqstr.next_t[main_t->pid];
-  struct proc* new_t;
+// CPU time the members of share group gid got, those that left
+// included, in 1/TICKFRAC of a tick; -1 if there is no such group.
+int
+sgroup_cputime(int gid)
+{
+  struct proc *p;
+  uint time;
 
-  if(!old_t){
-    old_t = main_t;
+  if(gid < 0 || gid >= NSGROUP)
+    return -1;
+  acquire(&sgtable.lock);
+  if(sgtable.g[gid].share == 0){
+    release(&sgtable.lock);
+    return -1;
   }
+  time = sgtable.g[gid].cputime;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->sgroup == gid && p->weight > 0 && p->lwpgroup == p)
+      time += p->gcputime;
+  release(&sgtable.lock);
+  return time;
+}
+
+// The main thread of process pid, or of the caller if pid is 0, with its
+// lock held, or 0 if there is none.
+static struct proc*
+lockproc(int pid)
+{
+  struct proc *p;
 
-  if(!old_t->t_link){
-    new_t = main_t;
+  if(pid == 0){
+    p = myproc()->lwpgroup;
+    acquire(&p->lock);
+    return p;
   }
-  else{
-    new_t = old_t->t_link;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid)
+      continue;
+    acquire(&p->lock);
+    if(p->pid == pid && p->lwpgroup == p && p->state != UNUSED &&
+       p->state != EMBRYO && p->state != ZOMBIE)
+      return p;
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// Let the process pid (0 for the caller), all its threads, run only on
+// the CPUs in mask, one bit each, from now on, and pass that on to the
+// children it forks. Waiting threads on a queue now ruled out move at
+// once; the others when they are next put back on a queue. The run
+// queue a stride or EDF process reserved its share on has to stay in
+// the mask. Returns -1 if not.
+int
+set_affinity(int pid, int mask)
+{
+  struct proc *p, *t;
+  struct runq *rq;
+  int moved;
+
+  if(ncpu < 32)
+    mask &= (1 << ncpu) - 1;
+  if(mask == 0 || (p = lockproc(pid)) == 0)
+    return -1;
+  if(classof(p)->pinned && !((mask >> p->rqid) & 1)){
+    release(&p->lock);
+    return -1;
   }
+  p->affinity = mask;
 
-  // when we search one full cycle and still couldnt find a runnable thread,
-  // we return -1;
-  while(new_t != old_t){
-    if(new_t->state == RUNNABLE && new_t->waiting_tid == -1){
-      mlfqstr.next_t[main_t->pid] = new_t;
-      return 0;
-    }
-    new_t = new_t->t_link;
-    if(!new_t){
-      new_t = main_t;
+  for(t = p; t; t = t->t_link){
+    if(t->state != RUNNABLE)
+      continue;
+    // steal() may move t until its queue is locked.
+    for(;;){
+      rq = &runqs[t->rqid];
+      acquire(&rq->lock);
+      if(rq == &runqs[t->rqid])
+        break;
+      release(&rq->lock);
     }
+    moved = 0;
+    if(!allowed(t, t->rqid))
+      moved = classof(t)->take(rq, t);
+    release(&rq->lock);
+    if(moved)
+      rqmove(t, placeproc(mask));
   }
-  
-  if(new_t->state == RUNNABLE && new_t->waiting_tid == -1){
-    mlfqstr.next_t[main_t->pid] = new_t;
-    return 0;
-  }
-  else{
-    mlfqstr.next_t[main_t->pid] = 0;
+  release(&p->lock);
+  return 0;
+}
+
+// The CPUs the process pid (0 for the caller) may run on, one bit each,
+// or -1 if there is no such process.
+int
+get_affinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if((p = lockproc(pid)) == 0)
     return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  if(ncpu < 32)
+    mask &= (1 << ncpu) - 1;
+  return mask;
+}
+
+// Take an UNUSED slot for a thread, as EMBRYO, so that nobody else takes it.
+struct proc* 
+find_unused(void){
+  struct proc* p;
+
+  for(p=ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      p->state = EMBRYO;
+      release(&p->lock);
+      return p;
+    }
+    release(&p->lock);
   }
+  return NULL;
 }
 
+// Give back a slot taken with find_unused().
 void
-add_thread(struct proc* p)
+release_unused(struct proc* p)
 {
-  acquire(&mlfqstr.lock);
-  struct proc* next_t = mlfqstr.next_t[p->lwpgroup->pid];
-  p->t_link = next_t->t_link;
-  next_t->t_link = p;
-  release(&mlfqstr.lock);
+  freeslot(p);
 }
 
-void rm_thread(struct proc* p)
+struct proc* 
+find_thread(int tid, int gid)
 {
-  // if thread to remove is not next_t, we dont do anything
-  // if it is, we call update_next_t()
+  struct proc* p;
+
+  // Only the group itself creates and frees its threads, so a thread
+  // found here stays until the caller joins it.
+  for(p=ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->lwpgroup &&
+       p->thread_id == tid && p->lwpgroup->pid==gid){
+      return p;
+    }
+  }
+  return NULL;
+
+}
 
+// Link the new thread p into its group's list of threads.
+// p's group lock should be acquired in caller.
+void
+add_thread(struct proc* p)
+{
   struct proc* main_t = p->lwpgroup;
-  struct proc* pptr = main_t;
 
-  acquire(&mlfqstr.lock);
-  if(mlfqstr.next_t[main_t->pid] == p){ // if the next thread pointer was pointing to this thread
-    update_next_t(main_t);
-  }
-  release(&mlfqstr.lock);
-  
+  p->t_link = main_t->t_link;
+  main_t->t_link = p;
+}
+
+// Unlink the exiting thread p from its group's list of threads.
+// p's group lock should be acquired in caller.
+void rm_thread(struct proc* p)
+{
+  struct proc* pptr = p->lwpgroup;
+
   while(pptr){
     if(pptr->t_link == p){
       pptr->t_link = p->t_link;
@@ -1101,22 +3401,15 @@ void rm_thread(struct proc* p)
   }
 }
 
+// Lock the scheduling state of p's LWP group.
 void
-acquire_ptable()
+acquire_group(struct proc* p)
 {
-  acquire(&ptable.lock);
+  acquire(&p->lwpgroup->lock);
 }
 
 void
-release_ptable()
+release_group(struct proc* p)
 {
-  release(&ptable.lock);
-}
-
-int is_holding_ptable(){
-  if(holding(&ptable.lock)){
-//    cprintf("holding ptable.lock\n");
-    return 1;
-  }
-  else return 0;
+  release(&p->lwpgroup->lock);
 }
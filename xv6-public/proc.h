@@ -8,6 +8,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint idle;          // Halted in scheduler() waiting for work?
+  struct proc *handoff;        // Thread given the CPU by yield_to(), to run next
+  struct qnode qnodes[NQNODE]; // Places in line for the spinlocks it holds or waits for
+  uint qnodeused;              // Bit i set while qnodes[i] is in use
+  pde_t *pgdir;                // User page table loaded, 0 if the kernel's
+  volatile uint tlbflush;      // Asked by tlbshootdown() to drop the TLB
 };
 
 extern struct cpu cpus[NCPU];
@@ -36,21 +42,51 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
-  uint level;                  // MLFQ priority level
-  uint timeallot;              // time allotment 
-  uint timequant;              // time quantum
-  uint tickcount;              // #of ticks this process has used
+  struct spinlock lock;        // A main thread's guards its group's scheduling state; see proc.c
+  uint level;                  // MLFQ priority level (of the group: main thread only)
+  uint timeallot;              // time allotment (main thread only)
+  uint timequant;              // time quantum (main thread only)
+  uint tickcount;              // time the group used at this level, in 1/TICKFRAC ticks
+  uint slice;                  // time used since last picked by scheduler(), in 1/TICKFRAC ticks
+  uint64 tscstart;             // TSC when last switched in or charged
+  uint cputime;                // CPU time used, in 1/TICKFRAC ticks
   uint ustack;
-  int share;                   // designated CPU share for stride scheduling
-  int stride;                  // stride = (int)(10,000 / cpu_share)
-  int pass;                    // pass += stride * (# of ticks used in current round)
-  int waiting_tid;
+  int share;                   // designated CPU share for stride scheduling (main thread only)
+  int stride;                  // stride = (int)(10,000 / cpu_share) (main thread only)
+  uint64 pass;                 // pass += stride * (CPU time used, in 1/TICKFRAC ticks)
+  int lag;                     // pass - vtime of its run queue when it last left the stride heap
+  uint runtime;                // EDF CPU time per period, in ticks (main thread only)
+  uint period;                 // EDF period, in ticks (main thread only)
+  uint deadline;               // tick the current EDF period ends at (main thread only)
+  int budget;                  // EDF CPU time left in this period, in 1/TICKFRAC ticks (main thread only)
+  uint pilevel;                // highest mlfq level lent by waiters for locks it holds, 0 if none
+  int boosted;                 // boosted by its run queue, not yet its group (see priboost())
+  uint64 pipass;               // lowest stride pass lent by waiters for locks it holds, 0 if none
+  int pilocks;                 // number of sleeplocks it holds
+  int cpu;                     // CPU it last ran on, -1 if none yet
+  uint lastrun;                // ticks when it last stopped running
+  uint affinity;               // CPUs its group may run on, one bit each (main thread only)
+  int sgroup;                  // share group it is in, -1 if none (main thread only)
+  int weight;                  // weight in its share group, 0 once it left (main thread only)
+  uint gcputime;               // CPU time of the whole LWP group, in 1/TICKFRAC ticks (main thread only)
+  uint sleepavg;               // I/O sleep less CPU time, in 1/TICKFRAC ticks (main thread only); see woken()
+  uint64 wakets;               // TSC when last woken up, 0 once it ran since
+  int wakeio;                  // last woken up by wakeup_io()
+  int tweight;                 // weight of this thread in its LWP group
+  int tweights;                // sum of the weights of the group's threads (main thread only)
   int thread_count;            // number of threads in a LWP group.
   int next_tid;
   int thread_id;               // thread_id in the case the proc is a LWP.
   struct proc* lwpgroup;       // points to the main thread process if this proc is a LWP.
   struct proc* t_link;    // pointer to the next thread(in the lwp group) to be scheduled.
-  struct proc* s_link;           // points to the next process when placed in stride queue. 
+  int hidx;                    // index in its run queue's stride heap, -1 if not in it.
+  int rqid;                    // index of the per-CPU run queue this process is placed on.
+  struct proc* q_next;         // next process in its run queue's mlfq level list.
+  struct proc* q_prev;         // previous process in its run queue's mlfq level list.
+  int queued;                  // non-zero while waiting on a mlfq level list.
+  int qlevel;                  // level of the list it waits on; the group's level may have changed since.
+  struct proc* w_next;         // next sleeper on the wait queue of chan.
+  struct proc* w_prev;         // previous sleeper on the wait queue of chan.
   int retval;
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
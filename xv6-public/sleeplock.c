@@ -19,18 +19,37 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+#ifdef LOCKSTAT
+  lockstat_register(&lk->stat, name, 1);
+#endif
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+#ifdef LOCKSTAT
+  uint64 t0 = 0;
+#endif
+
   acquire(&lk->lk);
   while (lk->locked) {
+#ifdef LOCKSTAT
+    if(t0 == 0)
+      t0 = rdtsc();
+#endif
     cprintf("sleep wait for buffer lock\n");
+    // Have the holder run soon enough to let go of the lock.
+    pilend(lk->owner);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+  piacquire(lk->owner);
+#ifdef LOCKSTAT
+  lockstat_acquired(&lk->stat, t0);
+#endif
   release(&lk->lk);
 }
 
@@ -38,8 +57,13 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  lockstat_released(&lk->stat);
+#endif
+  pirelease(lk->owner);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
@@ -6,5 +6,10 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  struct proc *owner; // Process holding lock, for priority inheritance
+#ifdef LOCKSTAT
+  struct lockstat stat;
+#endif
 };
 
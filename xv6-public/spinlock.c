@@ -1,4 +1,14 @@
 // Mutual exclusion spin locks.
+//
+// These are MCS queue locks. A CPU that wants a lock takes a queue
+// node of its own, swaps it in as the lock's tail and, if there was a
+// tail before, links itself behind it and spins on its own node until
+// the holder hands the lock over by clearing the node's wait flag. So
+// the lock goes to the waiting CPUs in the order they came, and each
+// spins on a cache line of its own rather than all on the lock.
+// Each CPU has NQNODE nodes, one for every lock it holds or is waiting
+// for; a lock is released on the CPU that acquired it, as spinlocks
+// are held with interrupts off.
 
 #include "types.h"
 #include "defs.h"
@@ -8,13 +18,43 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lockstat_register(&lk->stat, name, 0);
+#endif
+}
+
+// A free queue node of this CPU.
+// Interrupts should be off.
+static struct qnode*
+qnodealloc(void)
+{
+  struct cpu *c = mycpu();
+  int i;
+
+  for(i = 0; i < NQNODE; i++){
+    if(!(c->qnodeused & (1 << i))){
+      c->qnodeused |= 1 << i;
+      return &c->qnodes[i];
+    }
+  }
+  panic("qnodealloc");
+}
+
+static void
+qnodefree(struct qnode *n)
+{
+  struct cpu *c = mycpu();
+
+  c->qnodeused &= ~(1 << (n - c->qnodes));
 }
 
 // Acquire the lock.
@@ -24,33 +64,68 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct qnode *n, *prev;
+  struct cpu *c;
+#ifdef LOCKSTAT
+  uint64 t0 = 0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic(lk->name);
+  c = mycpu();
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  n = qnodealloc();
+  n->next = 0;
+  n->wait = 1;
+  // Get in line. The xchg is atomic.
+  prev = (struct qnode*)xchg((volatile uint*)&lk->tail, (uint)n);
+  if(prev){
+#ifdef LOCKSTAT
+    t0 = rdtsc();
+#endif
+    prev->next = n;
+    while(n->wait){
+      // The holder may be waiting for this CPU to drop its TLB, with
+      // interrupts off it cannot take the IPI.
+      tlbcheck(c);
+      pause();
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
   // references happen after the lock is acquired.
   __sync_synchronize();
 
+  lk->node = n;
+  lk->cpu = c;
+#ifdef LOCKDEBUG
   // Record info about lock acquisition for debugging.
-  lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#endif
+#ifdef LOCKSTAT
+  lockstat_acquired(&lk->stat, t0);
+#endif
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct qnode *n = lk->node;
+
   if(!holding(lk))
     //panic(lk->name);
     panic("release");
 
+#ifdef LOCKDEBUG
   lk->pcs[0] = 0;
+#endif
+#ifdef LOCKSTAT
+  lockstat_released(&lk->stat);
+#endif
+  lk->node = 0;
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -60,10 +135,19 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Free the lock if nobody is in line behind us. Otherwise hand it to
+  // the next in line, once it has linked itself in.
+  if(n->next == 0){
+    if(cmpxchg((volatile uint*)&lk->tail, (uint)n, 0) == (uint)n){
+      qnodefree(n);
+      popcli();
+      return;
+    }
+    while(n->next == 0)
+      pause();
+  }
+  n->next->wait = 0;
+  qnodefree(n);
 
   popcli();
 }
@@ -92,7 +176,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->tail && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -125,3 +209,101 @@ popcli(void)
     sti();
 }
 
+// Lock contention profiler.
+//
+// Built with make LOCKSTAT=1, every spinlock and sleeplock counts how
+// many times it was acquired, how many of those had to wait and for
+// how long, and the longest it was held, in TSC cycles. The counts are
+// kept under the lock they are about. initlock() and initsleeplock()
+// put the locks on a list for lockstat() to copy out, all but those in
+// memory from kalloc() (pipes), which would go away under the list, and
+// those in user memory.
+
+#ifdef LOCKSTAT
+extern char end[]; // first address after kernel loaded from ELF file
+
+static struct lockstat *lockstats;  // Registered locks, newest first
+
+static void
+lockstat_clear(struct lockstat *ls)
+{
+  ls->acquires = 0;
+  ls->contended = 0;
+  ls->wait = 0;
+  ls->maxhold = 0;
+}
+
+void
+lockstat_register(struct lockstat *ls, char *name, int sleep)
+{
+  struct lockstat *l;
+
+  ls->name = name;
+  ls->sleep = sleep;
+  lockstat_clear(ls);
+  if((char*)ls < (char*)KERNBASE || (char*)ls >= end)
+    return;
+  // A lock initialized again is on the list already. Locks are only
+  // ever added, so the list can be walked and pushed onto without a lock.
+  for(l = lockstats; l; l = l->next)
+    if(l == ls)
+      return;
+  do
+    ls->next = lockstats;
+  while(cmpxchg((volatile uint*)&lockstats, (uint)ls->next, (uint)ls) != (uint)ls->next);
+}
+
+// The lock was just acquired; t0 is the TSC when it started waiting,
+// 0 if it did not have to.
+void
+lockstat_acquired(struct lockstat *ls, uint64 t0)
+{
+  uint64 now = rdtsc();
+
+  ls->acquires++;
+  if(t0){
+    ls->contended++;
+    ls->wait += now - t0;
+  }
+  ls->start = now;
+}
+
+// The lock is about to be released.
+void
+lockstat_released(struct lockstat *ls)
+{
+  uint64 held = rdtsc() - ls->start;
+
+  if(held > ls->maxhold)
+    ls->maxhold = held;
+}
+#endif
+
+// Copy the statistics of up to n registered locks to buf and, if reset
+// is set, clear those of all of them. The counts are read and cleared
+// while the locks are in use, so a few may get lost. Returns the number
+// of registered locks, or -1 if the kernel keeps no statistics.
+int
+lockstat(struct lockstatent *buf, int n, int reset)
+{
+#ifdef LOCKSTAT
+  struct lockstat *l;
+  int i;
+
+  for(l = lockstats, i = 0; l; l = l->next, i++){
+    if(i < n){
+      safestrcpy(buf[i].name, l->name, LOCKNAME);
+      buf[i].sleep = l->sleep;
+      buf[i].acquires = l->acquires;
+      buf[i].contended = l->contended;
+      buf[i].waitkc = l->wait >> 40 ? 0xffffffff : (uint)(l->wait >> 10);
+      buf[i].maxhold = l->maxhold >> 32 ? 0xffffffff : (uint)l->maxhold;
+    }
+    if(reset)
+      lockstat_clear(l);
+  }
+  return i;
+#else
+  return -1;
+#endif
+}
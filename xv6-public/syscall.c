@@ -107,18 +107,29 @@ extern int sys_my_syscall(void);
 extern int sys_getppid(void);
 extern int sys_yield(void);
 extern int sys_getlev(void);
+extern int sys_yield_to(void);
+extern int sys_set_deadline(void);
+extern int sys_set_affinity(void);
+extern int sys_get_affinity(void);
+extern int sys_sgroup_create(void);
+extern int sys_sgroup_weight(void);
+extern int sys_sgroup_cputime(void);
+extern int sys_thread_setprio(void);
+extern int sys_mlfq_setparam(void);
+extern int sys_mlfq_getparam(void);
+extern int sys_wakelat(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_futex_timedwait(void);
+extern int sys_lockstat(void);
+extern int sys_thread_running(void);
+extern int sys_futex_wait_pi(void);
+extern int sys_futex_wake_pi(void);
 extern int sys_set_cpu_share(void);
+extern int sys_getcputime(void);
 extern int sys_thread_create(void);
 extern int sys_thread_exit(void);
 extern int sys_thread_join(void);
-extern int sys_xem_init(void);
-extern int sys_xem_wait(void);
-extern int sys_xem_post(void);
-extern int sys_rwlock_init(void);
-extern int sys_rwlock_acquire_readlock(void);
-extern int sys_rwlock_release_readlock(void);
-extern int sys_rwlock_acquire_writelock(void);
-extern int sys_rwlock_release_writelock(void);
 extern int sys_pread(void);
 extern int sys_pwrite(void);
 
@@ -152,16 +163,27 @@ static int (*syscalls[])(void) = {
 [SYS_thread_create] sys_thread_create,
 [SYS_thread_exit] sys_thread_exit,
 [SYS_thread_join] sys_thread_join,
-[SYS_xem_init] sys_xem_init,
-[SYS_xem_wait] sys_xem_wait,
-[SYS_xem_post] sys_xem_post,
-[SYS_rwlock_init] sys_rwlock_init,
-[SYS_rwlock_acquire_readlock] sys_rwlock_acquire_readlock,
-[SYS_rwlock_acquire_writelock] sys_rwlock_acquire_writelock,
-[SYS_rwlock_release_readlock] sys_rwlock_release_readlock,
-[SYS_rwlock_release_writelock] sys_rwlock_release_writelock,
 [SYS_pwrite] sys_pwrite,
 [SYS_pread] sys_pread,
+[SYS_getcputime] sys_getcputime,
+[SYS_yield_to] sys_yield_to,
+[SYS_set_deadline] sys_set_deadline,
+[SYS_set_affinity] sys_set_affinity,
+[SYS_get_affinity] sys_get_affinity,
+[SYS_sgroup_create] sys_sgroup_create,
+[SYS_sgroup_weight] sys_sgroup_weight,
+[SYS_sgroup_cputime] sys_sgroup_cputime,
+[SYS_thread_setprio] sys_thread_setprio,
+[SYS_mlfq_setparam] sys_mlfq_setparam,
+[SYS_mlfq_getparam] sys_mlfq_getparam,
+[SYS_wakelat] sys_wakelat,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_futex_timedwait] sys_futex_timedwait,
+[SYS_lockstat] sys_lockstat,
+[SYS_thread_running] sys_thread_running,
+[SYS_futex_wait_pi] sys_futex_wait_pi,
+[SYS_futex_wake_pi] sys_futex_wake_pi,
 };
 
 void
@@ -28,13 +28,24 @@
 #define SYS_thread_create 27
 #define SYS_thread_exit 28
 #define SYS_thread_join 29
-#define SYS_xem_init 30
-#define SYS_xem_wait 31
-#define SYS_xem_post 32
-#define SYS_rwlock_init 33
-#define SYS_rwlock_acquire_readlock 34
-#define SYS_rwlock_acquire_writelock 35
-#define SYS_rwlock_release_readlock 36
-#define SYS_rwlock_release_writelock 37
 #define SYS_pread 38
 #define SYS_pwrite 39
+#define SYS_getcputime 40
+#define SYS_yield_to 42
+#define SYS_set_deadline 43
+#define SYS_set_affinity 44
+#define SYS_get_affinity 45
+#define SYS_sgroup_create 46
+#define SYS_sgroup_weight 47
+#define SYS_sgroup_cputime 48
+#define SYS_thread_setprio 49
+#define SYS_mlfq_setparam 50
+#define SYS_mlfq_getparam 51
+#define SYS_wakelat 52
+#define SYS_futex_wait 53
+#define SYS_futex_wake 54
+#define SYS_futex_timedwait 55
+#define SYS_lockstat 56
+#define SYS_thread_running 57
+#define SYS_futex_wait_pi 58
+#define SYS_futex_wake_pi 59
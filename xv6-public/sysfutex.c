@@ -0,0 +1,57 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val, -1, 0);
+}
+
+int
+sys_futex_timedwait(void)
+{
+  int addr, val, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  return futex_wait(addr, val, n, 0);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n, 0);
+}
+
+int
+sys_futex_wait_pi(void)
+{
+  int addr, val, owner, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0 || argint(2, &owner) < 0 ||
+     argint(3, &n) < 0)
+    return -1;
+  return futex_wait(addr, val, n, owner);
+}
+
+int
+sys_futex_wake_pi(void)
+{
+  int addr, n, owner;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &owner) < 0)
+    return -1;
+  return futex_wake(addr, n, owner);
+}
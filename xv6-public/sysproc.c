@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "mlfq.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -56,9 +58,14 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  // Threads grow the memory of their group one at a time.
+  acquire_group(myproc());
+  addr = myproc()->lwpgroup->sz;
+  if(growproc(n) < 0){
+    release_group(myproc());
     return -1;
+  }
+  release_group(myproc());
   return addr;
 }
 
@@ -77,7 +84,8 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    // Nobody wakes up ticks0; the timer does, once, when n is up.
+    sleep_timeout(&ticks0, &tickslock, n - (ticks - ticks0));
   }
   release(&tickslock);
   return 0;
@@ -102,12 +110,86 @@ sys_yield(void)
    return yield();
 }
 
+int
+sys_yield_to(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return yield_to(tid);
+}
+
+int
+sys_thread_setprio(void)
+{
+  int tid, weight;
+
+  if(argint(0, &tid) < 0 || argint(1, &weight) < 0)
+    return -1;
+  return thread_setprio(tid, weight);
+}
+
+int
+sys_thread_running(void)
+{
+  int sp;
+
+  if(argint(0, &sp) < 0)
+    return -1;
+  return thread_running((uint)sp);
+}
+
 int 
 sys_getlev(void)
 {
   return getlev();
 }
 
+int
+sys_mlfq_setparam(void)
+{
+  struct mlfqparam *mp;
+
+  if(argptr(0, (char**)&mp, sizeof(*mp)) < 0)
+    return -1;
+  return mlfq_setparam(mp);
+}
+
+int
+sys_mlfq_getparam(void)
+{
+  struct mlfqparam *mp;
+
+  if(argptr(0, (char**)&mp, sizeof(*mp)) < 0)
+    return -1;
+  mlfq_getparam(mp);
+  return 0;
+}
+
+int
+sys_wakelat(void)
+{
+  int io;
+  uint *hist;
+
+  if(argint(0, &io) < 0 || argptr(1, (char**)&hist, NWAKELAT * sizeof(uint)) < 0)
+    return -1;
+  return wakelat(io, hist);
+}
+
+int
+sys_lockstat(void)
+{
+  int n, reset;
+  struct lockstatent *buf;
+
+  if(argint(1, &n) < 0 || n < 0 || argint(2, &reset) < 0 ||
+     argptr(0, (char**)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+  return lockstat(buf, n, reset);
+}
+
 int 
 sys_set_cpu_share(void){
   int share;
@@ -115,3 +197,69 @@ sys_set_cpu_share(void){
     return -1;
   return set_cpu_share(share);
 }
+
+int
+sys_set_deadline(void)
+{
+  int runtime, period;
+
+  if(argint(0, &runtime) < 0 || argint(1, &period) < 0)
+    return -1;
+  return set_deadline(runtime, period);
+}
+
+int
+sys_set_affinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return set_affinity(pid, mask);
+}
+
+int
+sys_get_affinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return get_affinity(pid);
+}
+
+int
+sys_sgroup_create(void)
+{
+  int share;
+
+  if(argint(0, &share) < 0)
+    return -1;
+  return sgroup_create(share);
+}
+
+int
+sys_sgroup_weight(void)
+{
+  int weight;
+
+  if(argint(0, &weight) < 0)
+    return -1;
+  return sgroup_weight(weight);
+}
+
+int
+sys_sgroup_cputime(void)
+{
+  int gid;
+
+  if(argint(0, &gid) < 0)
+    return -1;
+  return sgroup_cputime(gid);
+}
+
+int
+sys_getcputime(void)
+{
+  return getcputime();
+}
@@ -0,0 +1,75 @@
+/**
+ * CPU affinity test.
+ *
+ * usage: test_affinity
+ *
+ * Checks set_affinity()/get_affinity() on bad arguments and that a
+ * child inherits its parent's mask, then pins NHOGS compute bound
+ * processes to CPU 0 and prints the share of a CPU each got over
+ * DURATION ticks. Pinned together they should split one CPU, about
+ * 100 / NHOGS percent each, however many CPUs there are. Run it with
+ * CPUS=2 or more.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NHOGS     (2)
+#define DURATION  (200)   /* (ticks) */
+
+void
+hog(void)
+{
+  int start = uptime();
+  int cpu = getcputime();
+
+  while(uptime() - start < DURATION)
+    ;
+  // getcputime() counts in hundredths of a tick: per tick, that is percent.
+  printf(1, "pinned hog %d : %d%% of a CPU\n", getpid(),
+         (getcputime() - cpu) / (uptime() - start));
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int all, i, pid;
+
+  all = get_affinity(0);
+  if(all <= 0 || get_affinity(getpid()) != all){
+    printf(1, "FAIL : get_affinity\n");
+    exit();
+  }
+  if(set_affinity(0, 0) != -1 || set_affinity(-5, 1) != -1 ||
+     get_affinity(-5) != -1){
+    printf(1, "FAIL : bad arguments accepted\n");
+    exit();
+  }
+
+  if(set_affinity(0, 1) != 0 || get_affinity(0) != 1){
+    printf(1, "FAIL : set_affinity\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    if(get_affinity(0) != 1)
+      printf(1, "FAIL : mask not inherited\n");
+    exit();
+  }
+  wait();
+
+  for(i = 0; i < NHOGS; i++){
+    if((pid = fork()) < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0)
+      hog();
+  }
+  // The parent only waits, anywhere.
+  set_affinity(0, all);
+  for(i = 0; i < NHOGS; i++)
+    wait();
+  exit();
+}
@@ -0,0 +1,84 @@
+/**
+ * CPU time accounting test.
+ *
+ * usage: test_cputime
+ *
+ * Runs a mlfq process that never sleeps next to one that runs for about
+ * half a tick right after every timer tick and then sleeps until the
+ * next one, so that the timer never finds it running. Charged per tick,
+ * the sleeper would stay at level 2 forever and be charged nothing;
+ * charged for the time it really runs, it uses up its level 2 allotment
+ * and is lowered like anyone else.
+ *
+ * Each process reports the lowest level it was seen at and its CPU time
+ * from getcputime(), in hundredths of a tick.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME  (150)  /* (ticks) */
+
+/* Iterations of the spin loop that fit in a tick. */
+int
+calibrate(void)
+{
+  int t, n = 0;
+
+  t = uptime();
+  while(uptime() == t)
+    ;
+  t++;
+  while(uptime() == t)
+    n++;
+  return n;
+}
+
+void
+report(char *name, int minlev)
+{
+  int t = getcputime();
+
+  printf(1, "%s -> lowest level : %d, cputime : %d.%d%d ticks\n",
+         name, minlev, t / 100, t / 10 % 10, t % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, t, start, minlev, pid;
+
+  n = calibrate();
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "FAIL : fork\n");
+    exit();
+  }
+  start = uptime();
+  minlev = getlev();
+  if(pid == 0){
+    /* Never sleeps. */
+    while(uptime() - start < LIFETIME){
+      if(getlev() < minlev)
+        minlev = getlev();
+    }
+    report("compute", minlev);
+    exit();
+  }
+
+  /* Runs half a tick after each tick, then sleeps through the rest. */
+  while((t = uptime()) - start < LIFETIME){
+    for(i = 0; i < n / 2 && uptime() == t; i++)
+      ;
+    if(getlev() < minlev)
+      minlev = getlev();
+    sleep(1);
+  }
+  report("sleeper", minlev);
+  wait();
+
+  printf(1, "%s\n", minlev < 2 ? "OK" : "FAIL : sleeper never lowered");
+  exit();
+}
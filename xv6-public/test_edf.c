@@ -0,0 +1,80 @@
+/**
+ * EDF scheduling class test.
+ *
+ * usage: test_edf
+ *
+ * Checks that set_deadline() rejects bad arguments and bandwidth over
+ * MAXSHARE, then makes this process an EDF process with RUNTIME ticks
+ * in every PERIOD ticks next to NHOGS compute bound mlfq processes and
+ * prints the share of the CPU it got over DURATION ticks, which should
+ * be close to RUNTIME / PERIOD rather than 1 / (NHOGS + 1). Run it with
+ * CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define RUNTIME   (5)     /* (ticks) */
+#define PERIOD    (10)    /* (ticks) */
+#define NHOGS     (4)
+#define DURATION  (300)   /* (ticks) */
+
+void
+spin(int duration)
+{
+  int start = uptime();
+
+  while(uptime() - start < duration)
+    ;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NHOGS];
+  int i, start, cpu, share;
+
+  if(set_deadline(0, PERIOD) != -1 || set_deadline(RUNTIME, 0) != -1 ||
+     set_deadline(PERIOD + 1, PERIOD) != -1){
+    printf(1, "FAIL : set_deadline accepted bad arguments\n");
+    exit();
+  }
+  if(set_deadline(9, 10) != -1){
+    printf(1, "FAIL : set_deadline admitted 90%% of a CPU\n");
+    exit();
+  }
+
+  for(i = 0; i < NHOGS; i++){
+    if((pids[i] = fork()) == 0){
+      for(;;)
+        ;
+    }
+    if(pids[i] < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+  }
+
+  if(set_deadline(RUNTIME, PERIOD) != 0){
+    printf(1, "FAIL : set_deadline\n");
+    exit();
+  }
+
+  start = uptime();
+  cpu = getcputime();
+  spin(DURATION);
+  share = (getcputime() - cpu) / (uptime() - start);
+
+  for(i = 0; i < NHOGS; i++)
+    kill(pids[i]);
+  for(i = 0; i < NHOGS; i++)
+    wait();
+
+  // getcputime() counts in hundredths of a tick: per tick, that is percent.
+  printf(1, "edf %d/%d ticks next to %d hogs : %d%% of the CPU\n",
+         RUNTIME, PERIOD, NHOGS, share);
+  if(share < RUNTIME * 100 / PERIOD * 3 / 4)
+    printf(1, "FAIL : edf share too low\n");
+  exit();
+}
@@ -0,0 +1,83 @@
+/**
+ * Idle CPU benchmark.
+ *
+ * usage: test_idle [nworkers]
+ *
+ * Runs nworkers (default 1, half of the Makefile's CPUS=2) compute bound
+ * processes for LIFETIME ticks, leaving the other CPUs with nothing to
+ * do, and prints the work each one got done per tick.
+ *
+ * Idle CPUs halt in scheduler() until a timer tick or a wakeup IPI,
+ * instead of spinning on the run queues and ptable.lock. Watch the host
+ * CPU usage of qemu (top) while this runs: it should be close to
+ * nworkers CPUs, not all of them. The work per tick shows whether the
+ * busy CPUs go any faster with their idle neighbours out of the way.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME     (500)     /* (ticks) */
+#define COUNT_PERIOD (100000)  /* (iteration) */
+#define MAXWORKERS   (8)
+
+int
+main(int argc, char *argv[])
+{
+  int nworkers = 1;
+  int fds[2];
+  int i, pid, start, end, cnt, total = 0;
+
+  if(argc > 1)
+    nworkers = atoi(argv[1]);
+  if(nworkers <= 0 || nworkers > MAXWORKERS)
+    nworkers = 1;
+
+  if(pipe(fds) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  start = uptime() + 5;
+  end = start + LIFETIME;
+  for(i = 0; i < nworkers; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      int n = 0;
+
+      close(fds[0]);
+      cnt = 0;
+      while(uptime() < start)
+        sleep(1);
+      for(;;){
+        if(++n < COUNT_PERIOD)
+          continue;
+        n = 0;
+        if(uptime() >= end)
+          break;
+        cnt++;
+      }
+      write(fds[1], &cnt, sizeof(cnt));
+      exit();
+    }
+  }
+  close(fds[1]);
+
+  for(i = 0; i < nworkers; i++)
+    wait();
+  for(i = 0; i < nworkers; i++){
+    if(read(fds[0], &cnt, sizeof(cnt)) != sizeof(cnt)){
+      printf(1, "FAIL : report\n");
+      exit();
+    }
+    printf(1, "worker %d -> cnt : %d, cnt/tick : %d\n", i, cnt, cnt / LIFETIME);
+    total += cnt;
+  }
+  printf(1, "workers : %d, total cnt/tick : %d\n", nworkers, total / LIFETIME);
+  exit();
+}
@@ -0,0 +1,104 @@
+/**
+ * I/O-aware mlfq boost test.
+ *
+ * usage: test_iowake [rounds]
+ *
+ * An I/O bound process rewrites a small file ROUNDS times (default 200),
+ * each time waiting for the disk, next to NHOGS compute bound processes,
+ * and counts the levels it was at between writes. Credited for its waits
+ * on the disk, it should stay at the top levels rather than go down to
+ * level 0 between boosts. Then the wakeup to run latency histograms over
+ * the run are printed, of wakeups from I/O and of the others, in buckets
+ * of 1/100 tick doubling in width. Run it with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mlfq.h"
+
+#define ROUNDS    (200)
+#define NHOGS     (2)
+
+char buf[512];
+uint before[2][NWAKELAT], after[2][NWAKELAT];
+
+void
+printhist(char *name, int io)
+{
+  int i, lo;
+
+  printf(1, "%s wakeups :", name);
+  for(i = 0; i < NWAKELAT; i++){
+    if(after[io][i] == before[io][i])
+      continue;
+    lo = i ? 1 << (i - 1) : 0;
+    printf(1, " [%d%s] %d", lo, i == NWAKELAT - 1 ? "+" : "",
+           after[io][i] - before[io][i]);
+  }
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NHOGS];
+  int levels[NMLFQ];
+  int rounds = ROUNDS;
+  int fd, i, n, level, top;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0)
+    rounds = ROUNDS;
+
+  if(wakelat(2, before[0]) != -1){
+    printf(1, "FAIL : wakelat accepted a bad kind\n");
+    exit();
+  }
+  wakelat(0, before[0]);
+  wakelat(1, before[1]);
+
+  for(i = 0; i < NHOGS; i++){
+    if((pids[i] = fork()) == 0){
+      for(;;)
+        ;
+    }
+    if(pids[i] < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+  }
+
+  top = getlev();
+  for(i = 0; i < NMLFQ; i++)
+    levels[i] = 0;
+  for(n = 0; n < rounds; n++){
+    if((fd = open("iowake", O_CREATE | O_RDWR)) < 0){
+      printf(1, "FAIL : open iowake\n");
+      break;
+    }
+    write(fd, buf, sizeof(buf));
+    close(fd);
+    if((level = getlev()) >= 0 && level < NMLFQ)
+      levels[level]++;
+  }
+  unlink("iowake");
+
+  for(i = 0; i < NHOGS; i++)
+    kill(pids[i]);
+  for(i = 0; i < NHOGS; i++)
+    wait();
+
+  wakelat(0, after[0]);
+  wakelat(1, after[1]);
+
+  printf(1, "writes : %d, at level", n);
+  for(i = top; i >= 0; i--)
+    printf(1, " %d : %d", i, levels[i]);
+  printf(1, "\n");
+  printhist("I/O", 1);
+  printhist("other", 0);
+  exit();
+}
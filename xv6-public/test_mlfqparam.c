@@ -0,0 +1,103 @@
+/**
+ * Runtime MLFQ parameters test.
+ *
+ * usage: test_mlfqparam
+ *
+ * Checks that mlfq_setparam() rejects bad parameters, then switches to
+ * NLEVEL levels with short quanta and allotments and a BOOST tick boost
+ * period, and runs a compute bound child for DURATION ticks. The child
+ * should start at the new top level, go down to level 0 and be boosted
+ * back to the top; it prints the levels it went through and how many
+ * times it came back up. The old parameters are put back at the end.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mlfq.h"
+
+#define NLEVEL    (5)
+#define BOOST     (50)    /* (ticks) */
+#define DURATION  (200)   /* (ticks) */
+
+struct mlfqparam old, p;
+
+void
+hog(void)
+{
+  int seen[NMLFQ];
+  int i, start, level, last, boosts = 0;
+
+  for(i = 0; i < NMLFQ; i++)
+    seen[i] = 0;
+  start = uptime();
+  last = getlev();
+  if(last != NLEVEL - 1)
+    printf(1, "FAIL : started at level %d\n", last);
+  while(uptime() - start < DURATION){
+    level = getlev();
+    if(level < 0 || level >= NLEVEL){
+      printf(1, "FAIL : level %d\n", level);
+      exit();
+    }
+    seen[level] = 1;
+    if(level > last)
+      boosts++;
+    last = level;
+  }
+  printf(1, "levels seen :");
+  for(i = NLEVEL - 1; i >= 0; i--)
+    if(seen[i])
+      printf(1, " %d", i);
+  printf(1, ", boosts : %d\n", boosts);
+  if(!seen[0] || boosts == 0)
+    printf(1, "FAIL : did not go down and back up\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(mlfq_getparam(&old) != 0){
+    printf(1, "FAIL : mlfq_getparam\n");
+    exit();
+  }
+  printf(1, "levels : %d, boost : %d ticks\n", old.nlevel, old.boost);
+  for(i = old.nlevel - 1; i >= 0; i--)
+    printf(1, "level %d : quantum %d, allotment %d\n",
+           i, old.quantum[i], old.allot[i]);
+
+  p = old;
+  p.nlevel = 0;
+  if(mlfq_setparam(&p) != -1){
+    printf(1, "FAIL : no levels accepted\n");
+    exit();
+  }
+  p = old;
+  p.quantum[0] = 0;
+  if(mlfq_setparam(&p) != -1){
+    printf(1, "FAIL : empty quantum accepted\n");
+    exit();
+  }
+
+  p.nlevel = NLEVEL;
+  p.boost = BOOST;
+  for(i = 0; i < NLEVEL; i++){
+    p.quantum[i] = NLEVEL - i;
+    p.allot[i] = i > 0 ? 2 * (NLEVEL - i) : 0;
+  }
+  if(mlfq_setparam(&p) != 0){
+    printf(1, "FAIL : mlfq_setparam\n");
+    exit();
+  }
+
+  if(fork() == 0)
+    hog();
+  wait();
+
+  if(mlfq_setparam(&old) != 0)
+    printf(1, "FAIL : could not put the old parameters back\n");
+  exit();
+}
@@ -0,0 +1,172 @@
+/**
+ * Adaptive mutex test and benchmark.
+ *
+ * usage: test_mutex [ticks]
+ *
+ * Checks thread_running() on the caller, on a sleeping thread and on an
+ * address no stack holds, that mutex_trylock() fails on a held mutex
+ * and that mutex_t keeps NTHREAD threads incrementing a counter from
+ * losing updates. Then NTHREAD threads take turns at a short critical
+ * section for the given number of ticks (default 100), once under a
+ * mutex_t and once under an xem_t, and it prints the critical sections
+ * run per tick with each. The mutex should do more, as its waiters spin
+ * instead of sleeping while the holder runs. Run it with CPUS=2 or more.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD   (4)
+#define NINC      (2000)
+#define DURATION  (100)   /* (ticks) */
+
+mutex_t mutex;
+xem_t sem;
+volatile int gcnt, stop, usesem;
+volatile uint sleeper;
+int ops[NTHREAD];
+
+void*
+sleep_main(void *arg)
+{
+  int here;
+
+  sleeper = (uint)&here;
+  sleep(50);
+  thread_exit(0);
+  return 0;
+}
+
+void*
+inc_main(void *arg)
+{
+  int i, tmp;
+
+  for(i = 0; i < NINC; i++){
+    mutex_lock(&mutex);
+    tmp = gcnt;
+    if(i % 64 == 0)
+      yield();
+    gcnt = tmp + 1;
+    mutex_unlock(&mutex);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void*
+bench_main(void *arg)
+{
+  int id = (int)arg;
+  int i;
+
+  while(!stop){
+    if(usesem)
+      xem_wait(&sem);
+    else
+      mutex_lock(&mutex);
+    for(i = 0; i < 50; i++)
+      gcnt++;
+    if(usesem)
+      xem_post(&sem);
+    else
+      mutex_unlock(&mutex);
+    ops[id]++;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void
+spawn(thread_t *t, void *(*fn)(void*), int arg)
+{
+  if(thread_create(t, fn, (void*)arg) != 0){
+    printf(1, "FAIL : thread_create\n");
+    exit();
+  }
+}
+
+int
+bench(int duration)
+{
+  thread_t threads[NTHREAD];
+  void *retval;
+  int i, n;
+
+  stop = 0;
+  for(i = 0; i < NTHREAD; i++){
+    ops[i] = 0;
+    spawn(&threads[i], bench_main, i);
+  }
+  sleep(duration);
+  stop = 1;
+  n = 0;
+  for(i = 0; i < NTHREAD; i++){
+    thread_join(threads[i], &retval);
+    n += ops[i];
+  }
+  return n / duration;
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t threads[NTHREAD];
+  int duration = DURATION;
+  int i, here, rmutex, rsem;
+  void *retval;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(duration <= 0)
+    duration = DURATION;
+
+  if(thread_running(&here) != 1){
+    printf(1, "FAIL : thread_running on the caller\n");
+    exit();
+  }
+  if(thread_running(0) != -1){
+    printf(1, "FAIL : thread_running on no stack\n");
+    exit();
+  }
+  spawn(&threads[0], sleep_main, 0);
+  while(sleeper == 0)
+    sleep(1);
+  sleep(5);
+  if(thread_running((void*)sleeper) != 0)
+    printf(1, "FAIL : thread_running on a sleeping thread\n");
+  thread_join(threads[0], &retval);
+
+  mutex_init(&mutex);
+  xem_init(&sem);
+  mutex_lock(&mutex);
+  if(mutex_trylock(&mutex) != -1){
+    printf(1, "FAIL : mutex_trylock took a held mutex\n");
+    exit();
+  }
+  mutex_unlock(&mutex);
+  if(mutex_trylock(&mutex) != 0){
+    printf(1, "FAIL : mutex_trylock\n");
+    exit();
+  }
+  mutex_unlock(&mutex);
+
+  gcnt = 0;
+  for(i = 0; i < NTHREAD; i++)
+    spawn(&threads[i], inc_main, i);
+  for(i = 0; i < NTHREAD; i++)
+    thread_join(threads[i], &retval);
+  if(gcnt != NTHREAD * NINC){
+    printf(1, "FAIL : mutex lost updates, %d of %d\n", gcnt, NTHREAD * NINC);
+    exit();
+  }
+
+  usesem = 0;
+  rmutex = bench(duration);
+  usesem = 1;
+  rsem = bench(duration);
+  printf(1, "%d threads : %d critical sections per tick with mutex_t, %d with xem_t\n",
+         NTHREAD, rmutex, rsem);
+  exit();
+}
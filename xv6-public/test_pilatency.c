@@ -0,0 +1,118 @@
+/**
+ * Interactive latency under background I/O.
+ *
+ * usage: test_pilatency [rounds]
+ *
+ * NIO writers keep rewriting files of their own, holding buffer and
+ * inode sleeplocks, while NHOGS compute bound processes push them down
+ * the mlfq levels. Meanwhile an interactive process wakes up every tick
+ * and reads a small file, ROUNDS times (default 100), and prints how
+ * many ticks each read took: mean, 95th percentile and max. Without
+ * priority inheritance a read that needs a lock a writer at level 0
+ * holds waits behind the hogs. Run it with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define ROUNDS    (100)
+#define NIO       (2)
+#define NHOGS     (2)
+#define MAXLAT    (64)   /* (ticks) */
+
+char buf[512];
+char name[] = "pi_io0";
+
+void
+writer(int id)
+{
+  int fd, i;
+
+  name[5] = '0' + id;
+  for(;;){
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf(1, "FAIL : open %s\n", name);
+      exit();
+    }
+    for(i = 0; i < 40; i++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+    unlink(name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NIO + NHOGS];
+  int hist[MAXLAT + 1];
+  int rounds = ROUNDS;
+  int fd, i, n, t, total, max, p95;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0)
+    rounds = ROUNDS;
+
+  if((fd = open("pi_small", O_CREATE | O_RDWR)) < 0){
+    printf(1, "FAIL : open pi_small\n");
+    exit();
+  }
+  write(fd, buf, sizeof(buf));
+  close(fd);
+
+  for(i = 0; i < NIO + NHOGS; i++){
+    if((pids[i] = fork()) == 0){
+      if(i < NIO)
+        writer(i);
+      for(;;)
+        ;
+    }
+    if(pids[i] < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+  }
+
+  memset(hist, 0, sizeof(hist));
+  for(n = 0; n < rounds; n++){
+    sleep(1);
+    t = uptime();
+    if((fd = open("pi_small", O_RDONLY)) < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "FAIL : read pi_small\n");
+      break;
+    }
+    close(fd);
+    t = uptime() - t;
+    hist[t < MAXLAT ? t : MAXLAT]++;
+  }
+
+  for(i = 0; i < NIO + NHOGS; i++)
+    kill(pids[i]);
+  for(i = 0; i < NIO + NHOGS; i++)
+    wait();
+  for(i = 0; i < NIO; i++){
+    name[5] = '0' + i;
+    unlink(name);
+  }
+  unlink("pi_small");
+
+  total = max = 0;
+  p95 = -1;
+  for(t = 0, i = 0; t <= MAXLAT; t++){
+    total += t * hist[t];
+    if(hist[t])
+      max = t;
+    i += hist[t];
+    if(p95 < 0 && i * 100 >= n * 95)
+      p95 = t;
+  }
+  if(n == 0)
+    n = 1;
+  printf(1, "reads : %d, mean : %d.%d%d ticks, p95 : %d ticks, max : %d%s ticks\n",
+         n, total / n, total * 10 / n % 10, total * 100 / n % 10, p95, max,
+         max == MAXLAT ? "+" : "");
+  exit();
+}
@@ -0,0 +1,85 @@
+/**
+ * Process syscall scalability benchmark.
+ *
+ * usage: test_procbench [nworkers]
+ *
+ * Runs nworkers (default 4) unrelated processes for LIFETIME ticks, each
+ * of them in a loop of fork, exit and wait of a child that does nothing,
+ * followed by a sleep/wakeup round trip over its own pipe. None of them
+ * share anything but the kernel, so with per-process locks the loops
+ * should not get in each other's way, and the total number of rounds per
+ * tick should grow with the number of CPUs. Run it with different CPUS=
+ * values and compare.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME    (500)  /* (ticks) */
+#define MAXWORKERS  (16)
+
+int
+main(int argc, char *argv[])
+{
+  int nworkers = 4;
+  int res[2], fds[2];
+  int i, pid, start, end, rounds, total = 0;
+  char c = 0;
+
+  if(argc > 1)
+    nworkers = atoi(argv[1]);
+  if(nworkers <= 0 || nworkers > MAXWORKERS)
+    nworkers = 4;
+
+  if(pipe(res) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  start = uptime() + 5;
+  end = start + LIFETIME;
+  for(i = 0; i < nworkers; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      close(res[0]);
+      if(pipe(fds) < 0){
+        printf(1, "FAIL : pipe\n");
+        exit();
+      }
+      rounds = 0;
+      while(uptime() < start)
+        sleep(1);
+      while(uptime() < end){
+        pid = fork();
+        if(pid < 0)
+          break;
+        if(pid == 0)
+          exit();
+        wait();
+        if(write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1)
+          break;
+        rounds++;
+      }
+      write(res[1], &rounds, sizeof(rounds));
+      exit();
+    }
+  }
+  close(res[1]);
+
+  for(i = 0; i < nworkers; i++){
+    if(read(res[0], &rounds, sizeof(rounds)) != sizeof(rounds))
+      break;
+    total += rounds;
+  }
+  for(i = 0; i < nworkers; i++)
+    wait();
+
+  printf(1, "workers : %d, rounds : %d, ticks : %d, rounds/tick : %d\n",
+         nworkers, total, LIFETIME, total / LIFETIME);
+  exit();
+}
@@ -0,0 +1,148 @@
+/**
+ * Semaphore and readers-writer lock throughput benchmark.
+ *
+ * usage: test_rwbench [ticks]
+ *
+ * First checks that xem_t keeps NTHREAD threads incrementing a counter
+ * from losing updates. Then, for the given number of ticks each (default
+ * 100), counts the operations done:
+ *  - uncontended: one thread taking and releasing a semaphore, a read
+ *    lock and a write lock in turn, which should not enter the kernel;
+ *  - contended: NREADERS threads taking the read lock and NWRITERS the
+ *    write lock, writers updating a pair of words that readers check
+ *    they always see equal.
+ * Prints operations per tick for each.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD   (8)
+#define NINC      (2000)
+#define NREADERS  (6)
+#define NWRITERS  (2)
+#define DURATION  (100)   /* (ticks) */
+
+xem_t sem;
+rwlock_t rwlock;
+volatile int gcnt, stop, race;
+volatile int pair[2];
+int ops[NREADERS + NWRITERS];
+
+void*
+inc_main(void *arg)
+{
+  int i, tmp;
+
+  for(i = 0; i < NINC; i++){
+    xem_wait(&sem);
+    tmp = gcnt;
+    if(i % 64 == 0)
+      yield();
+    gcnt = tmp + 1;
+    xem_post(&sem);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void*
+reader_main(void *arg)
+{
+  int id = (int)arg;
+
+  while(!stop){
+    rwlock_acquire_readlock(&rwlock);
+    if(pair[0] != pair[1])
+      race = 1;
+    rwlock_release_readlock(&rwlock);
+    ops[id]++;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void*
+writer_main(void *arg)
+{
+  int id = (int)arg;
+
+  while(!stop){
+    rwlock_acquire_writelock(&rwlock);
+    pair[0]++;
+    pair[1]++;
+    rwlock_release_writelock(&rwlock);
+    ops[id]++;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void
+spawn(thread_t *t, void *(*fn)(void*), int arg)
+{
+  if(thread_create(t, fn, (void*)arg) != 0){
+    printf(1, "FAIL : thread_create\n");
+    exit();
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t threads[NREADERS + NWRITERS];
+  int duration = DURATION;
+  int i, n, start, reads, writes;
+  void *retval;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(duration <= 0)
+    duration = DURATION;
+
+  xem_init(&sem);
+  rwlock_init(&rwlock);
+
+  gcnt = 0;
+  for(i = 0; i < NTHREAD; i++)
+    spawn(&threads[i], inc_main, i);
+  for(i = 0; i < NTHREAD; i++)
+    thread_join(threads[i], &retval);
+  if(gcnt != NTHREAD * NINC){
+    printf(1, "FAIL : semaphore lost updates, %d of %d\n", gcnt, NTHREAD * NINC);
+    exit();
+  }
+
+  start = uptime();
+  for(n = 0; uptime() - start < duration; n++){
+    xem_wait(&sem);
+    xem_post(&sem);
+    rwlock_acquire_readlock(&rwlock);
+    rwlock_release_readlock(&rwlock);
+    rwlock_acquire_writelock(&rwlock);
+    rwlock_release_writelock(&rwlock);
+  }
+  printf(1, "uncontended : %d rounds of 3 locks per tick\n", n / duration);
+
+  stop = 0;
+  for(i = 0; i < NREADERS; i++)
+    spawn(&threads[i], reader_main, i);
+  for(i = NREADERS; i < NREADERS + NWRITERS; i++)
+    spawn(&threads[i], writer_main, i);
+  sleep(duration);
+  stop = 1;
+  for(i = 0; i < NREADERS + NWRITERS; i++)
+    thread_join(threads[i], &retval);
+
+  reads = writes = 0;
+  for(i = 0; i < NREADERS; i++)
+    reads += ops[i];
+  for(i = NREADERS; i < NREADERS + NWRITERS; i++)
+    writes += ops[i];
+  printf(1, "contended : %d reads and %d writes per tick, %d readers, %d writers\n",
+         reads / duration, writes / duration, NREADERS, NWRITERS);
+  if(race)
+    printf(1, "FAIL : a reader saw a write half done\n");
+  exit();
+}
@@ -0,0 +1,140 @@
+/**
+ * Readers-writer lock policy benchmark.
+ *
+ * usage: test_rwfair [ticks]
+ *
+ * For each policy, and for a read mostly and an even mix of NTHREAD
+ * threads, runs the threads for the given number of ticks (default 100),
+ * each taking the lock over and over, holding it for a while and then
+ * thinking for a while. Prints reads and writes per tick and the longest
+ * any reader and any writer waited for the lock, in ticks. Preferring
+ * readers, writers should starve under the read mostly mix, and
+ * preferring writers, readers under the even one; phase-fair, nobody
+ * should wait long under either.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD   (8)
+#define HOLD      (2000)    /* (loop iterations) */
+#define THINK     (500)     /* (loop iterations) */
+#define DURATION  (100)     /* (ticks) */
+
+rwlock_t rwlock;
+volatile int stop;
+volatile int shared[2];
+int ops[NTHREAD], maxwait[NTHREAD];
+int nwriters;
+
+char *policies[] = { "prefer readers", "prefer writers", "phase-fair" };
+
+void
+busy(int n)
+{
+  volatile int i;
+
+  for(i = 0; i < n; i++)
+    ;
+}
+
+void*
+worker(void *arg)
+{
+  int id = (int)arg;
+  int write = id < nwriters;
+  int t, wait;
+
+  while(!stop){
+    t = uptime();
+    if(write)
+      rwlock_acquire_writelock(&rwlock);
+    else
+      rwlock_acquire_readlock(&rwlock);
+    if((wait = uptime() - t) > maxwait[id])
+      maxwait[id] = wait;
+    if(write){
+      shared[0]++;
+      busy(HOLD);
+      shared[1]++;
+      rwlock_release_writelock(&rwlock);
+    } else {
+      if(shared[0] != shared[1])
+        printf(1, "FAIL : reader saw a write half done\n");
+      busy(HOLD);
+      rwlock_release_readlock(&rwlock);
+    }
+    ops[id]++;
+    busy(THINK);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void
+run(int policy, int writers, int duration)
+{
+  thread_t threads[NTHREAD];
+  int i, reads, writes, rwait, wwait;
+  void *retval;
+
+  rwlock_init(&rwlock);
+  if(rwlock_setpolicy(&rwlock, policy) != 0){
+    printf(1, "FAIL : rwlock_setpolicy\n");
+    exit();
+  }
+  nwriters = writers;
+  stop = 0;
+  for(i = 0; i < NTHREAD; i++){
+    ops[i] = maxwait[i] = 0;
+    if(thread_create(&threads[i], worker, (void*)i) != 0){
+      printf(1, "FAIL : thread_create\n");
+      exit();
+    }
+  }
+  sleep(duration);
+  stop = 1;
+  for(i = 0; i < NTHREAD; i++)
+    thread_join(threads[i], &retval);
+
+  reads = writes = rwait = wwait = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(i < writers){
+      writes += ops[i];
+      if(maxwait[i] > wwait)
+        wwait = maxwait[i];
+    } else {
+      reads += ops[i];
+      if(maxwait[i] > rwait)
+        rwait = maxwait[i];
+    }
+  }
+  printf(1, "%s, %d readers %d writers : %d reads, %d writes per tick, "
+         "longest wait : reader %d, writer %d ticks\n",
+         policies[policy], NTHREAD - writers, writers,
+         reads / duration, writes / duration, rwait, wwait);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int duration = DURATION;
+  int policy;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(duration <= 0)
+    duration = DURATION;
+
+  rwlock_init(&rwlock);
+  if(rwlock_setpolicy(&rwlock, 3) != -1){
+    printf(1, "FAIL : bad policy accepted\n");
+    exit();
+  }
+  for(policy = RW_PREFER_READERS; policy <= RW_PHASEFAIR; policy++){
+    run(policy, 1, duration);
+    run(policy, NTHREAD / 2, duration);
+  }
+  exit();
+}
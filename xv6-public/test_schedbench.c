@@ -0,0 +1,114 @@
+/**
+ * Context switch throughput benchmark.
+ *
+ * usage: test_schedbench [npairs]
+ *
+ * Runs npairs (default 4) pairs of processes that bounce a byte back and
+ * forth over a pair of pipes for LIFETIME ticks. Every round trip is two
+ * sleep/wakeup context switches, so the total number of round trips per
+ * tick is a measure of how fast the scheduler can switch when all CPUs
+ * are busy switching at the same time. Run it with different CPUS= values
+ * to see how the switch rate scales with the number of CPUs.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME  (500)  /* (ticks) */
+#define MAXPAIRS  (16)
+
+int
+pingpong(int rfd, int wfd, int starter)
+{
+  int rounds = 0;
+  int start_tick;
+  char c = 0;
+
+  start_tick = uptime();
+  if(starter && write(wfd, &c, 1) != 1)
+    return -1;
+
+  for(;;){
+    if(read(rfd, &c, 1) != 1)
+      break;
+    rounds++;
+    if(uptime() - start_tick > LIFETIME){
+      /* Time to terminate; closing wfd ends the partner's read loop. */
+      break;
+    }
+    if(write(wfd, &c, 1) != 1)
+      break;
+  }
+  return rounds;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npairs = 4;
+  int i, side;
+  int ab[2], ba[2], res[2];
+  int rounds, total = 0;
+  int start_tick, elapsed;
+
+  if(argc > 1)
+    npairs = atoi(argv[1]);
+  if(npairs <= 0 || npairs > MAXPAIRS)
+    npairs = 4;
+
+  if(pipe(res) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  start_tick = uptime();
+  for(i = 0; i < npairs; i++){
+    if(pipe(ab) < 0 || pipe(ba) < 0){
+      printf(1, "FAIL : pipe\n");
+      exit();
+    }
+    for(side = 0; side < 2; side++){
+      int pid = fork();
+      if(pid < 0){
+        printf(1, "FAIL : fork\n");
+        exit();
+      }
+      if(pid == 0){
+        close(res[0]);
+        if(side == 0){
+          close(ab[0]);
+          close(ba[1]);
+          rounds = pingpong(ba[0], ab[1], 1);
+        } else {
+          close(ab[1]);
+          close(ba[0]);
+          rounds = pingpong(ab[0], ba[1], 0);
+        }
+        write(res[1], &rounds, sizeof(rounds));
+        exit();
+      }
+    }
+    close(ab[0]);
+    close(ab[1]);
+    close(ba[0]);
+    close(ba[1]);
+  }
+  close(res[1]);
+
+  for(i = 0; i < 2 * npairs; i++){
+    if(read(res[0], &rounds, sizeof(rounds)) != sizeof(rounds))
+      break;
+    total += rounds;
+  }
+  for(i = 0; i < 2 * npairs; i++)
+    wait();
+  elapsed = uptime() - start_tick;
+  if(elapsed <= 0)
+    elapsed = 1;
+
+  /* Each side counts the messages it received, one switch apiece. */
+  printf(1, "pairs : %d, switches : %d, ticks : %d, switches/tick : %d\n",
+         npairs, total, elapsed, total / elapsed);
+  exit();
+}
@@ -0,0 +1,86 @@
+/**
+ * Share group test.
+ *
+ * usage: test_sgroup
+ *
+ * Creates a share group with SHARE percent of a CPU and forks NWORKERS
+ * compute bound workers into it, with weights 1, 2, ..., next to NHOGS
+ * compute bound mlfq processes outside of it. Each worker prints the
+ * share of a CPU it got over DURATION ticks, which should grow with its
+ * weight, and the parent prints what the group got as a whole, which
+ * should be about SHARE. Run it with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define SHARE     (40)    /* (percent) */
+#define NWORKERS  (3)
+#define NHOGS     (2)
+#define DURATION  (300)   /* (ticks) */
+
+void
+spin(int duration)
+{
+  int start = uptime();
+
+  while(uptime() - start < duration)
+    ;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NHOGS];
+  int gid, i, pid, start, time, cpu;
+
+  if(sgroup_create(0) != -1 || sgroup_weight(1) != -1 || sgroup_cputime(-1) != -1){
+    printf(1, "FAIL : bad arguments accepted\n");
+    exit();
+  }
+
+  for(i = 0; i < NHOGS; i++){
+    if((pids[i] = fork()) == 0){
+      for(;;)
+        ;
+    }
+  }
+
+  if((gid = sgroup_create(SHARE)) < 0){
+    printf(1, "FAIL : sgroup_create\n");
+    exit();
+  }
+  if(sgroup_create(SHARE) != -1 || set_cpu_share(10) != -1){
+    printf(1, "FAIL : member got a share of its own\n");
+    exit();
+  }
+
+  start = uptime();
+  time = sgroup_cputime(gid);
+  for(i = 0; i < NWORKERS; i++){
+    if((pid = fork()) < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      sgroup_weight(i + 1);
+      cpu = getcputime();
+      spin(DURATION);
+      // getcputime() counts in hundredths of a tick: per tick, that is percent.
+      printf(1, "worker of weight %d : %d%% of a CPU\n", i + 1,
+             (getcputime() - cpu) / DURATION);
+      exit();
+    }
+  }
+  for(i = 0; i < NWORKERS; i++)
+    wait();
+  printf(1, "group of share %d : %d%% of a CPU\n", SHARE,
+         (sgroup_cputime(gid) - time) / (uptime() - start));
+
+  for(i = 0; i < NHOGS; i++)
+    kill(pids[i]);
+  for(i = 0; i < NHOGS; i++)
+    wait();
+  exit();
+}
@@ -0,0 +1,151 @@
+/**
+ * Multiprocessor stride share test.
+ *
+ * usage: test_smpshare [ncpu]
+ *
+ * Runs three stride processes with 40%, 20% and 10% shares per CPU
+ * (ncpu defaults to 2, the Makefile's CPUS) next to two mlfq processes
+ * per CPU that never sleep, for LIFETIME ticks. With the mlfq busy on
+ * every CPU, a stride process should get exactly its share of one CPU:
+ * no more because a CPU of its own was free, no less because its CPU
+ * was overbooked.
+ *
+ * The work one CPU gets done in a tick is measured first by running a
+ * single process alone. Each stride process's work is then compared
+ * with its share of that, and the error is printed in tenths of a
+ * percent of a CPU. Finally, a set_cpu_share() asking for more than is left
+ * on the machine has to fail, as does one larger than a single CPU
+ * can give.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME     (600)     /* (ticks) */
+#define CALTIME      (100)     /* (ticks) */
+#define COUNT_PERIOD (100000)  /* (iteration) */
+#define MAXERROR     (30)      /* (0.1% of a CPU) */
+
+#define MAXCPU       (8)
+#define NSHARE       (3)
+#define NHOG         (2)
+
+int shares[NSHARE] = {40, 20, 10};
+
+/* Count work units until tick end. */
+int
+spin(int end)
+{
+  int i = 0, cnt = 0;
+
+  for(;;){
+    if(++i < COUNT_PERIOD)
+      continue;
+    i = 0;
+    if(uptime() >= end)
+      break;
+    cnt++;
+  }
+  return cnt;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ncpu = 2;
+  int fds[2];
+  int i, pid, start, nstride, nproc;
+  int rate, cnt, expect, got, err, maxerr = 0;
+  int report[2];
+
+  if(argc > 1)
+    ncpu = atoi(argv[1]);
+  if(ncpu <= 0 || ncpu > MAXCPU)
+    ncpu = 2;
+
+  /* Work units a single CPU does in CALTIME ticks, the machine idle. */
+  start = uptime() + 1;
+  while(uptime() < start)
+    ;
+  rate = spin(start + CALTIME);
+  if(rate == 0){
+    printf(1, "FAIL : calibration\n");
+    exit();
+  }
+
+  if(pipe(fds) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  nstride = NSHARE * ncpu;
+  nproc = nstride + NHOG * ncpu;
+  start = uptime() + 10;
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(i < nstride && set_cpu_share(shares[i % NSHARE]) != 0){
+        printf(1, "FAIL : set_cpu_share(%d)\n", shares[i % NSHARE]);
+        exit();
+      }
+      while(uptime() < start)
+        sleep(1);
+      report[0] = i;
+      report[1] = spin(start + LIFETIME);
+      write(fds[1], report, sizeof(report));
+      exit();
+    }
+  }
+  for(i = 0; i < nproc; i++){
+    if(read(fds[0], report, sizeof(report)) != sizeof(report)){
+      printf(1, "FAIL : report\n");
+      exit();
+    }
+    if(report[0] >= nstride)
+      continue;
+    cnt = report[1];
+    expect = shares[report[0] % NSHARE] * 10;
+    got = cnt * 1000 / (rate * (LIFETIME / CALTIME));
+    err = got > expect ? got - expect : expect - got;
+    if(err > maxerr)
+      maxerr = err;
+    printf(1, "STRIDE(%d%%) -> cnt : %d, expected : %d, got : %d, error : %d\n",
+           shares[report[0] % NSHARE], cnt, expect, got, err);
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+
+  /* Admission: fill every CPU up to MAXSHARE, then nothing more fits. */
+  if(set_cpu_share(81) == 0)
+    maxerr = -1;
+  for(i = 0; i < ncpu; i++){
+    pid = fork();
+    if(pid == 0){
+      close(fds[0]);
+      report[0] = set_cpu_share(80);
+      write(fds[1], report, sizeof(report));
+      sleep(100);
+      exit();
+    }
+  }
+  for(i = 0; i < ncpu; i++)
+    if(read(fds[0], report, sizeof(report)) != sizeof(report) || report[0] != 0)
+      maxerr = -1;
+  if(set_cpu_share(10) == 0)
+    maxerr = -1;
+  for(i = 0; i < ncpu; i++)
+    wait();
+  if(maxerr < 0){
+    printf(1, "FAIL : admission\n");
+    exit();
+  }
+
+  printf(1, "max error : %d (0.1%% of a CPU), %s\n", maxerr, maxerr <= MAXERROR ? "OK" : "FAIL");
+  exit();
+}
@@ -0,0 +1,154 @@
+/**
+ * Stride fairness error test.
+ *
+ * usage: test_stridefair
+ *
+ * Runs stride processes with 10%, 20% and 30% shares next to a mlfq
+ * process for LIFETIME ticks, and a second 10% stride process that sleeps
+ * through the first half and only joins for the second half. Every worker
+ * counts the work it gets done in each half, and the test compares each
+ * worker's part of the total with the part its share entitles it to:
+ * share / (sum of the shares of the workers running in that half), the
+ * mlfq getting what is not reserved.
+ *
+ * The error of each worker is printed in tenths of a percent. A late
+ * joiner that started at pass 0 would take most of the CPU for a while
+ * and push the second half errors far above MAXERROR.
+ *
+ * Shares are kept per run queue, so run this with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME     (600)     /* (ticks) */
+#define COUNT_PERIOD (100000)  /* (iteration) */
+#define MAXERROR     (30)      /* (0.1%) */
+
+#define NWORKER      (5)
+
+struct worker {
+  int share;      /* 0 for the mlfq worker */
+  int late;       /* sleeps through the first half */
+};
+
+struct report {
+  int id;
+  int cnt[2];
+};
+
+struct worker workers[NWORKER] = {
+  {10, 0},
+  {20, 0},
+  {30, 0},
+  {0, 0},
+  {10, 1},
+};
+
+void
+work(int id, int start, int rfd)
+{
+  struct report r;
+  int i = 0, now;
+
+  if(workers[id].share && set_cpu_share(workers[id].share) != 0){
+    printf(1, "FAIL : set_cpu_share\n");
+    exit();
+  }
+
+  r.id = id;
+  r.cnt[0] = r.cnt[1] = 0;
+
+  now = uptime();
+  if(now < start)
+    sleep(start - now);
+  if(workers[id].late)
+    sleep(LIFETIME / 2);
+
+  for(;;){
+    if(++i < COUNT_PERIOD)
+      continue;
+    i = 0;
+    now = uptime();
+    if(now - start > LIFETIME)
+      break;
+    r.cnt[now - start >= LIFETIME / 2]++;
+  }
+  write(rfd, &r, sizeof(r));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct report reports[NWORKER], r;
+  int fds[2];
+  int i, h, pid, start;
+  int total, reserved, share, expect, got, err, maxerr = 0;
+
+  if(pipe(fds) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  start = uptime() + 10;
+  for(i = 0; i < NWORKER; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      work(i, start, fds[1]);
+      exit();
+    }
+  }
+  close(fds[1]);
+
+  for(i = 0; i < NWORKER; i++){
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r) || r.id < 0 || r.id >= NWORKER){
+      printf(1, "FAIL : report\n");
+      exit();
+    }
+    reports[r.id] = r;
+  }
+  for(i = 0; i < NWORKER; i++)
+    wait();
+
+  /* All stride shares are reserved for the whole run, sleeping or not. */
+  reserved = 0;
+  for(i = 0; i < NWORKER; i++)
+    reserved += workers[i].share;
+
+  for(h = 0; h < 2; h++){
+    total = 0;
+    share = 0;
+    for(i = 0; i < NWORKER; i++){
+      if(h == 0 && workers[i].late)
+        continue;
+      total += reports[i].cnt[h];
+      share += workers[i].share ? workers[i].share : 100 - reserved;
+    }
+    if(total == 0){
+      printf(1, "FAIL : no work done\n");
+      exit();
+    }
+    for(i = 0; i < NWORKER; i++){
+      if(h == 0 && workers[i].late)
+        continue;
+      expect = (workers[i].share ? workers[i].share : 100 - reserved) * 1000 / share;
+      got = reports[i].cnt[h] * 1000 / total;
+      err = got > expect ? got - expect : expect - got;
+      if(err > maxerr)
+        maxerr = err;
+      printf(1, "half %d, %s(%d%%) -> cnt : %d, expected : %d, got : %d, error : %d\n",
+             h, workers[i].share ? "STRIDE" : "MLFQ",
+             workers[i].share ? workers[i].share : 100 - reserved,
+             reports[i].cnt[h], expect, got, err);
+    }
+  }
+
+  printf(1, "max error : %d (0.1%%), %s\n", maxerr, maxerr <= MAXERROR ? "OK" : "FAIL");
+  exit();
+}
@@ -0,0 +1,122 @@
+/**
+ * Context switch latency benchmark.
+ *
+ * usage: test_switchbench [rounds]
+ *
+ * Bounces a byte ROUNDS times (default 20000) over a pair of pipes,
+ * first between two threads of one process and then between two
+ * processes, and prints the ticks each took. Every round trip is two
+ * switches; between threads the page table stays loaded, so the thread
+ * case should be the faster one. Run it with CPUS=1 so that every round
+ * trip really goes through the scheduler.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS  (20000)
+
+int rounds = ROUNDS;
+int ping[2], pong[2];
+
+void
+bounce(int in, int out)
+{
+  char c;
+  int i;
+
+  for(i = 0; i < rounds; i++){
+    if(read(in, &c, 1) != 1 || write(out, &c, 1) != 1){
+      printf(1, "FAIL : bounce\n");
+      exit();
+    }
+  }
+}
+
+// Sends rounds bytes and waits for each to come back.
+void
+serve(void)
+{
+  char c = 'x';
+  int i;
+
+  for(i = 0; i < rounds; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf(1, "FAIL : serve\n");
+      exit();
+    }
+  }
+}
+
+void*
+threadmain(void *arg)
+{
+  bounce(ping[0], pong[1]);
+  thread_exit(0);
+  return 0;
+}
+
+void
+mkpipes(void)
+{
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+}
+
+void
+closepipes(void)
+{
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t thread;
+  void *retval;
+  int start, tthread, tproc;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0)
+    rounds = ROUNDS;
+
+  mkpipes();
+  start = uptime();
+  if(thread_create(&thread, threadmain, 0) != 0){
+    printf(1, "FAIL : thread_create\n");
+    exit();
+  }
+  serve();
+  if(thread_join(thread, &retval) != 0){
+    printf(1, "FAIL : thread_join\n");
+    exit();
+  }
+  tthread = uptime() - start;
+  closepipes();
+
+  mkpipes();
+  start = uptime();
+  switch(fork()){
+  case -1:
+    printf(1, "FAIL : fork\n");
+    exit();
+  case 0:
+    bounce(ping[0], pong[1]);
+    exit();
+  }
+  serve();
+  wait();
+  tproc = uptime() - start;
+  closepipes();
+
+  printf(1, "rounds : %d, threads : %d ticks, processes : %d ticks\n",
+         rounds, tthread, tproc);
+  exit();
+}
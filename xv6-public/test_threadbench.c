@@ -0,0 +1,78 @@
+/**
+ * LWP thread speedup benchmark.
+ *
+ * usage: test_threadbench [nthreads]
+ *
+ * Does WORK units of compute bound work, first in the main thread alone
+ * and then split evenly over nthreads (default 4) threads, and prints
+ * the ticks each took and the speedup, in hundredths. Threads are
+ * scheduled on their own, so the speedup should grow with the number of
+ * CPUs up to nthreads. Run it with CPUS=1 to 8 and compare.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define WORK        (400)     /* (units) */
+#define UNIT        (100000)  /* (iteration) */
+#define MAXTHREADS  (8)
+
+volatile int sink;
+
+void
+work(int units)
+{
+  int i, j;
+
+  for(i = 0; i < units; i++)
+    for(j = 0; j < UNIT; j++)
+      sink += j;
+}
+
+void*
+threadmain(void *arg)
+{
+  work((int)arg);
+  thread_exit(arg);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t threads[MAXTHREADS];
+  int nthreads = 4;
+  int i, start, t1, tn;
+  void *retval;
+
+  if(argc > 1)
+    nthreads = atoi(argv[1]);
+  if(nthreads <= 0 || nthreads > MAXTHREADS)
+    nthreads = 4;
+
+  start = uptime();
+  work(WORK);
+  t1 = uptime() - start;
+
+  start = uptime();
+  for(i = 0; i < nthreads; i++){
+    if(thread_create(&threads[i], threadmain, (void*)(WORK / nthreads)) != 0){
+      printf(1, "FAIL : thread_create\n");
+      exit();
+    }
+  }
+  for(i = 0; i < nthreads; i++){
+    if(thread_join(threads[i], &retval) != 0 || (int)retval != WORK / nthreads){
+      printf(1, "FAIL : thread_join\n");
+      exit();
+    }
+  }
+  tn = uptime() - start;
+
+  if(tn == 0)
+    tn = 1;
+  printf(1, "threads : %d, 1 thread : %d ticks, %d threads : %d ticks, speedup : %d.%d%d\n",
+         nthreads, t1, nthreads, tn, t1 / tn, t1 * 10 / tn % 10, t1 * 100 / tn % 10);
+  exit();
+}
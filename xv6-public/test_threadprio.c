@@ -0,0 +1,91 @@
+/**
+ * Per-thread weights test.
+ *
+ * usage: test_threadprio
+ *
+ * Checks thread_setprio() on bad arguments, then runs NTHREADS compute
+ * bound threads of weights 1, 2, ... for DURATION ticks, first in a
+ * mlfq group and then in a stride group of SHARE percent, and prints
+ * the part of the group's work each thread did. The parts should grow
+ * with the weights, about weight / (1 + 2 + ...) each, rather than be
+ * equal. Run it with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREADS  (3)
+#define SHARE     (40)    /* (percent) */
+#define DURATION  (200)   /* (ticks) */
+
+volatile int stop;
+volatile uint work[NTHREADS];
+thread_t threads[NTHREADS];
+
+void*
+worker(void *arg)
+{
+  int id = (int)arg;
+
+  while(!stop)
+    work[id]++;
+  thread_exit(0);
+  return 0;
+}
+
+void
+run(char *name)
+{
+  void *retval;
+  uint total;
+  int i;
+
+  stop = 0;
+  for(i = 0; i < NTHREADS; i++){
+    work[i] = 0;
+    if(thread_create(&threads[i], worker, (void*)i) != 0){
+      printf(1, "FAIL : thread_create\n");
+      exit();
+    }
+    if(thread_setprio(threads[i].thread_id, i + 1) != 0){
+      printf(1, "FAIL : thread_setprio\n");
+      exit();
+    }
+  }
+  sleep(DURATION);
+  stop = 1;
+  for(i = 0; i < NTHREADS; i++)
+    thread_join(threads[i], &retval);
+
+  total = 0;
+  for(i = 0; i < NTHREADS; i++)
+    total += work[i] / 1000;
+  if(total == 0)
+    total = 1;
+  for(i = 0; i < NTHREADS; i++)
+    printf(1, "%s thread of weight %d : %d%% of the work\n", name, i + 1,
+           work[i] / 1000 * 100 / total);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(thread_setprio(0, 0) != -1 || thread_setprio(0, 1001) != -1 ||
+     thread_setprio(1000, 1) != -1){
+    printf(1, "FAIL : bad arguments accepted\n");
+    exit();
+  }
+  if(thread_setprio(0, 1) != 0){
+    printf(1, "FAIL : thread_setprio on the main thread\n");
+    exit();
+  }
+
+  run("mlfq");
+  if(set_cpu_share(SHARE) != 0){
+    printf(1, "FAIL : set_cpu_share\n");
+    exit();
+  }
+  run("stride");
+  exit();
+}
@@ -0,0 +1,91 @@
+/**
+ * Timer wheel test.
+ *
+ * usage: test_timer
+ *
+ * Sleeps from a tick that is a multiple of the first level of the wheel
+ * (64 ticks) for 64 ticks, so that the timer cascades down in the very
+ * tick it is due in, and checks that it still goes off in that tick.
+ * Then forks sleepers for a range of durations, some of them beyond the
+ * first level so that they have to cascade down, and checks that each
+ * wakes up exactly when its time is up. Every sleep starts right after
+ * a wakeup, so that it starts on a known tick. Then checks
+ * xem_timedwait(): it has to give up on a taken semaphore after its
+ * timeout, and take a free one right away.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSLEEPER (6)
+
+int durations[NSLEEPER] = {1, 5, 63, 64, 130, 300};
+
+int
+main(int argc, char *argv[])
+{
+  xem_t sem;
+  int fds[2], report[2];
+  int i, pid, start, slept, fail = 0;
+
+  sleep(64 - uptime() % 64);
+  start = uptime();
+  sleep(64);
+  slept = uptime() - start;
+  printf(1, "sleep(64) from tick %d -> slept : %d\n", start, slept);
+  if(start % 64 != 0 || slept != 64)
+    fail = 1;
+
+  if(pipe(fds) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  for(i = 0; i < NSLEEPER; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      sleep(1);
+      start = uptime();
+      sleep(durations[i]);
+      report[0] = i;
+      report[1] = uptime() - start;
+      write(fds[1], report, sizeof(report));
+      exit();
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < NSLEEPER; i++){
+    if(read(fds[0], report, sizeof(report)) != sizeof(report)){
+      printf(1, "FAIL : report\n");
+      exit();
+    }
+    slept = report[1];
+    if(slept != durations[report[0]])
+      fail = 1;
+    printf(1, "sleep(%d) -> slept : %d\n", durations[report[0]], slept);
+  }
+  for(i = 0; i < NSLEEPER; i++)
+    wait();
+
+  xem_init(&sem);
+  xem_wait(&sem);
+  start = uptime();
+  if(xem_timedwait(&sem, 20) != -1)
+    fail = 1;
+  slept = uptime() - start;
+  printf(1, "xem_timedwait(20) on a taken semaphore -> waited : %d\n", slept);
+  if(slept < 20 || slept > 21)
+    fail = 1;
+  xem_post(&sem);
+  if(xem_timedwait(&sem, 20) != 0)
+    fail = 1;
+
+  printf(1, "%s\n", fail ? "FAIL" : "OK");
+  exit();
+}
@@ -0,0 +1,84 @@
+/**
+ * Sleep/wakeup benchmark.
+ *
+ * usage: test_wakeup [nsleepers]
+ *
+ * Parks nsleepers (default 32) processes in read() on pipes of their
+ * own, each sleeping on a channel of its own, and then has two processes
+ * ping-pong a byte over a pair of pipes for LIFETIME ticks. Every round
+ * trip is two wakeups; with wait queues hashed by channel they only
+ * look at the sleepers of one bucket, not at the whole process table,
+ * so the rounds per tick should not drop as nsleepers grows. Run it with
+ * 0 and with many sleepers and compare. The sleepers are killed at the
+ * end, which takes them off their wait queues.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define LIFETIME     (300)  /* (ticks) */
+#define MAXSLEEPERS  (48)
+
+int
+main(int argc, char *argv[])
+{
+  int nsleepers = 32;
+  int own[2], ping[2], pong[2];
+  int pids[MAXSLEEPERS];
+  int i, pid, end, rounds = 0;
+  char c = 0;
+
+  if(argc > 1)
+    nsleepers = atoi(argv[1]);
+  if(nsleepers < 0 || nsleepers > MAXSLEEPERS)
+    nsleepers = 32;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "FAIL : pipe\n");
+    exit();
+  }
+
+  /* Each sleeper blocks on a pipe of its own until it is killed. */
+  for(i = 0; i < nsleepers; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf(1, "FAIL : fork\n");
+      exit();
+    }
+    if(pids[i] == 0){
+      if(pipe(own) < 0)
+        exit();
+      read(own[0], &c, 1);
+      exit();
+    }
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "FAIL : fork\n");
+    exit();
+  }
+  if(pid == 0){
+    while(read(ping[0], &c, 1) == 1 && c == 0)
+      write(pong[1], &c, 1);
+    exit();
+  }
+
+  end = uptime() + LIFETIME;
+  while(uptime() < end){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+      break;
+    rounds++;
+  }
+  c = 1;
+  write(ping[1], &c, 1);
+  for(i = 0; i < nsleepers; i++)
+    kill(pids[i]);
+  for(i = 0; i < nsleepers + 1; i++)
+    wait();
+
+  printf(1, "sleepers : %d, rounds : %d, ticks : %d, rounds/tick : %d\n",
+         nsleepers, rounds, LIFETIME, rounds / LIFETIME);
+  exit();
+}
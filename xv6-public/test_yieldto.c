@@ -0,0 +1,102 @@
+/**
+ * Directed yield ping-pong benchmark.
+ *
+ * usage: test_yieldto [ticks]
+ *
+ * The main thread and one other thread pass a turn back and forth
+ * through shared memory for the given number of ticks (default 100),
+ * first handing the CPU to each other with yield_to() and then waiting
+ * with yield(), and prints the round trips done each way. yield() only
+ * gives up the CPU once the time quantum is used up, so yield_to()
+ * should do many times more round trips. Run it with CPUS=1.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define DURATION  (100)   /* (ticks) */
+
+volatile int turn, stop, directed;
+thread_t thread;
+
+// Let the other side run until it is side's turn again.
+void
+await(int side, int other)
+{
+  while(turn != side && !stop){
+    if(directed)
+      yield_to(other);
+    else
+      yield();
+  }
+}
+
+void*
+threadmain(void *arg)
+{
+  for(;;){
+    await(1, 0);
+    if(stop)
+      break;
+    turn = 0;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int
+pingpong(int duration)
+{
+  void *retval;
+  int start, rounds = 0;
+
+  turn = 0;
+  stop = 0;
+  if(thread_create(&thread, threadmain, 0) != 0){
+    printf(1, "FAIL : thread_create\n");
+    exit();
+  }
+  start = uptime();
+  while(uptime() - start < duration){
+    turn = 1;
+    await(0, thread.thread_id);
+    rounds++;
+  }
+  stop = 1;
+  if(thread_join(thread, &retval) != 0){
+    printf(1, "FAIL : thread_join\n");
+    exit();
+  }
+  return rounds;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int duration = DURATION;
+  int rdirected, ryield;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(duration <= 0)
+    duration = DURATION;
+
+  if(yield_to(0) != -1){
+    printf(1, "FAIL : yield_to self\n");
+    exit();
+  }
+  if(yield_to(1000) != -1){
+    printf(1, "FAIL : yield_to unknown thread\n");
+    exit();
+  }
+
+  directed = 1;
+  rdirected = pingpong(duration);
+  directed = 0;
+  ryield = pingpong(duration);
+
+  printf(1, "ticks : %d, round trips with yield_to : %d, with yield : %d\n",
+         duration, rdirected, ryield);
+  exit();
+}
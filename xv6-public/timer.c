@@ -0,0 +1,147 @@
+// Hierarchical timer wheel.
+//
+// Pending timers are kept in NLEVEL wheels of NSLOT slots. Level 0 has
+// a slot per tick for the next NSLOT ticks, level 1 a slot per NSLOT
+// ticks, and so on. Whenever level 0 comes round, the current slot of
+// level 1 is due and its timers are spread over level 0, and likewise
+// between the higher levels. Starting and stopping a timer takes
+// constant time, and a tick only looks at the timers that expire in it,
+// plus a cascade every NSLOT ticks.
+//
+// Timers further out than the wheels reach are parked as far out as
+// they go and put back when their slot cascades.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define SLOTBITS 6
+#define NSLOT    (1 << SLOTBITS)
+#define NLEVEL   3
+#define MAXDELTA ((1 << (SLOTBITS * NLEVEL)) - 1)
+
+struct {
+  struct spinlock lock;
+  uint now;                           // Last tick the wheel has run
+  struct timer *slots[NLEVEL][NSLOT];
+} wheel;
+
+void
+timerinit(void)
+{
+  initlock(&wheel.lock, "timer");
+}
+
+// Put t in the slot it is due in. Caller holds wheel.lock.
+// A timer cascades down in the tick it is due in, before the level 0
+// slot of that tick is run, and so goes in that slot.
+static void
+enqueue(struct timer *t)
+{
+  int delta = t->expires - wheel.now;
+  uint at = t->expires;
+  int level;
+
+  if(delta < 0)
+    at = wheel.now + 1;
+  else if(delta > MAXDELTA)
+    at = wheel.now + MAXDELTA;
+  for(level = 0; level < NLEVEL - 1; level++)
+    if(at - wheel.now < (1 << (SLOTBITS * (level + 1))))
+      break;
+  t->slot = &wheel.slots[level][(at >> (SLOTBITS * level)) & (NSLOT - 1)];
+
+  t->prev = 0;
+  t->next = *t->slot;
+  if(t->next)
+    t->next->prev = t;
+  *t->slot = t;
+}
+
+// Take t off its slot. Caller holds wheel.lock.
+static void
+dequeue(struct timer *t)
+{
+  if(t->prev)
+    t->prev->next = t->next;
+  else
+    *t->slot = t->next;
+  if(t->next)
+    t->next->prev = t->prev;
+  t->next = t->prev = 0;
+  t->slot = 0;
+}
+
+// Arm t to go off n ticks from now, at least one.
+void
+timerstart(struct timer *t, int n)
+{
+  acquire(&wheel.lock);
+  if(t->slot)
+    dequeue(t);
+  t->fired = 0;
+  t->expires = wheel.now + (n > 0 ? n : 1);
+  enqueue(t);
+  release(&wheel.lock);
+}
+
+// Disarm t. Once this returns, t->fn is not running and will not be
+// called. Returns 1 if t had not gone off yet.
+int
+timerstop(struct timer *t)
+{
+  int pending;
+
+  acquire(&wheel.lock);
+  pending = t->slot != 0;
+  if(pending)
+    dequeue(t);
+  release(&wheel.lock);
+  return pending;
+}
+
+// Spread the timers of a higher level slot over the levels below.
+static void
+cascade(int level)
+{
+  struct timer **slot, *t;
+
+  slot = &wheel.slots[level][(wheel.now >> (SLOTBITS * level)) & (NSLOT - 1)];
+  while((t = *slot) != 0){
+    dequeue(t);
+    enqueue(t);
+  }
+}
+
+// Run the timers due up to ticks.
+// Called by the timer interrupt with tickslock held.
+void
+timertick(void)
+{
+  struct timer **slot, *t;
+  int level;
+
+  acquire(&wheel.lock);
+  while(wheel.now != ticks){
+    wheel.now++;
+    for(level = 1; level < NLEVEL; level++){
+      if((wheel.now >> (SLOTBITS * (level - 1))) & (NSLOT - 1))
+        break;
+      cascade(level);
+    }
+    slot = &wheel.slots[0][wheel.now & (NSLOT - 1)];
+    while((t = *slot) != 0){
+      dequeue(t);
+      if((int)(t->expires - wheel.now) > 0){
+        // Parked beyond the reach of the wheels.
+        enqueue(t);
+        continue;
+      }
+      t->fired = 1;
+      t->fn(t);
+    }
+  }
+  release(&wheel.lock);
+}
@@ -0,0 +1,11 @@
+// Timer wheel entry.
+// The owner sets fn and hands it to timerstart(); fn is called from
+// the timer interrupt, with the wheel locked, when the timer expires.
+struct timer {
+  struct timer *next;         // Neighbours in its wheel slot
+  struct timer *prev;
+  struct timer **slot;        // Wheel slot it is in, 0 if not pending
+  uint expires;               // Tick to go off at
+  volatile int fired;         // Has gone off?
+  void (*fn)(struct timer*);  // What to do when it goes off
+};
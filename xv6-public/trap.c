@@ -13,6 +13,26 @@ struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+uint tsc_per_unit;      // TSC cycles per 1/TICKFRAC tick, 0 until measured
+
+#define TSCCALTICKS 10  // ticks to measure the TSC rate over
+
+// Measure the TSC rate against the timer over the first ticks after boot.
+// CPU time accounting (see account() in proc.c) charges whole ticks
+// until this is done. tickslock should be acquired in caller.
+static void
+tsccalibrate(void)
+{
+  static uint64 tsc0;
+
+  if(ticks == 1)
+    tsc0 = rdtsc();
+  else if(ticks == 1 + TSCCALTICKS){
+    tsc_per_unit = (uint)(rdtsc() - tsc0) / (TSCCALTICKS * TICKFRAC);
+    if(tsc_per_unit == 0)
+      tsc_per_unit = 1;
+  }
+}
 
 void
 tvinit(void)
@@ -55,9 +75,19 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks); // set all process's state to RUNNABLE
+      tsccalibrate();
+      timertick();
       release(&tickslock);
     }
+    mlfqboost();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Only there to end the hlt in scheduler()'s idle loop.
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLBFLUSH:
+    tlbcheck(mycpu());
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      20      // IPI to wake a halted CPU
+#define IRQ_TLBFLUSH    21      // IPI to reload %cr3, see tlbshootdown()
 #define IRQ_SPURIOUS    31
 
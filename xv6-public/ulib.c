@@ -104,3 +104,317 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+//PAGEBREAK!
+// Semaphores and readers-writer locks, on futexes.
+// Taking a free semaphore or lock, and releasing one nobody waits for,
+// is an atomic instruction and no system call. Only a thread that has
+// to wait, and one that has to wake up waiters, enters the kernel.
+// waiters counts the threads in futex_wait() or about to be. A waiter
+// raises it before the kernel checks the word it sleeps on once more,
+// and a releaser changes the word before it reads waiters, so either
+// the releaser sees the waiter or the waiter sees the change.
+// A semaphore used as a lock gets priority inheritance: the thread that
+// takes the last unit is its holder until the next post, and waiters
+// lend it their priority meanwhile (see futex_wait_pi()). Whoever posts,
+// the holder gives back what it was lent when waiters are woken.
+
+int
+xem_init(xem_t *sem)
+{
+  sem->value = 1;
+  sem->waiters = 0;
+  sem->holder = 0;
+  return 0;
+}
+
+// Take a unit if there is one. Returns 0 if there was none.
+static int
+xem_trywait(xem_t *sem)
+{
+  uint v;
+
+  while((int)(v = sem->value) > 0){
+    if(cmpxchg(&sem->value, v, v - 1) == v){
+      if(v == 1)
+        sem->holder = (uint)&v;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int
+xem_wait(xem_t *sem)
+{
+  while(!xem_trywait(sem)){
+    fetchadd(&sem->waiters, 1);
+    futex_wait_pi(&sem->value, 0, (void*)sem->holder, -1);
+    fetchadd(&sem->waiters, -1);
+  }
+  return 0;
+}
+
+// Like xem_wait(), but give up after n ticks.
+// Returns -1 if the semaphore could not be taken in time.
+int
+xem_timedwait(xem_t *sem, int n)
+{
+  int start = uptime();
+  int left;
+
+  while(!xem_trywait(sem)){
+    if((left = n - (uptime() - start)) <= 0)
+      return -1;
+    fetchadd(&sem->waiters, 1);
+    futex_wait_pi(&sem->value, 0, (void*)sem->holder, left);
+    fetchadd(&sem->waiters, -1);
+  }
+  return 0;
+}
+
+int
+xem_post(xem_t *sem)
+{
+  uint holder = xchg(&sem->holder, 0);
+
+  fetchadd(&sem->value, 1);
+  if(sem->waiters)
+    futex_wake_pi(&sem->value, 1, (void*)holder);
+  return 0;
+}
+
+// A lock for short critical sections in user space: 0 is free, 1 taken
+// and 2 taken with threads waiting in futex_wait() for it, so that a
+// release only enters the kernel if someone may be waiting.
+static void
+ulock(volatile uint *l)
+{
+  uint c;
+
+  if((c = cmpxchg(l, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(l, 2);
+  while(c != 0){
+    futex_wait(l, 2);
+    c = xchg(l, 2);
+  }
+}
+
+static void
+uunlock(volatile uint *l)
+{
+  if(fetchadd(l, -1) != 1){
+    *l = 0;
+    futex_wake(l, 1);
+  }
+}
+
+//PAGEBREAK!
+// Adaptive mutexes.
+// A mutex is a ulock() that a thread finding it held first spins for,
+// as long as the holder is running on another CPU and for at most
+// MUTEX_SPIN pause()s: a short critical section is over sooner than
+// sleeping in futex_wait() and being woken would take. A holder that is
+// not running cannot let go until it runs again, so then the thread
+// goes to sleep right away. The holder is known by an address on its
+// stack, which is all thread_running() needs, so taking a free mutex
+// stays a single cmpxchg.
+
+#define MUTEX_SPIN  (1 << 12)   // most pause()s to spin for a holder
+#define MUTEX_CHECK (1 << 6)    // pause()s between thread_running()s
+
+int
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+  m->owner = 0;
+  return 0;
+}
+
+// Spin while m's holder is running. Returns 1 if m was taken meanwhile.
+static int
+mutex_spin(mutex_t *m)
+{
+  uint owner;
+  int i;
+
+  for(i = 0; i < MUTEX_SPIN; i++){
+    if(i % MUTEX_CHECK == 0){
+      // A holder not known yet has only just taken it.
+      owner = m->owner;
+      if(owner && thread_running((void*)owner) != 1)
+        return 0;
+    }
+    pause();
+    if(m->state == 0 && cmpxchg(&m->state, 0, 1) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+int
+mutex_lock(mutex_t *m)
+{
+  uint self;
+
+  if(cmpxchg(&m->state, 0, 1) != 0 && !mutex_spin(m))
+    ulock(&m->state);
+  m->owner = (uint)&self;
+  return 0;
+}
+
+// Take m if it is free. Returns 0 if it was, -1 if not.
+int
+mutex_trylock(mutex_t *m)
+{
+  uint self;
+
+  if(cmpxchg(&m->state, 0, 1) != 0)
+    return -1;
+  m->owner = (uint)&self;
+  return 0;
+}
+
+int
+mutex_unlock(mutex_t *m)
+{
+  m->owner = 0;
+  uunlock(&m->state);
+  return 0;
+}
+
+//PAGEBREAK!
+// Readers-writer locks.
+// Threads that cannot go in right away wait in turn, writers one by one
+// in the order of their tickets (wnext, wgrant), readers all together
+// for the next reader phase (rphase). Whoever releases the lock hands
+// it over: it counts the next writer or all the waiting readers in as
+// holders before waking them, so they cannot be overtaken on the way,
+// and wakes up a phase of readers with a single futex_wake(). Who goes
+// next depends on the policy:
+//  - RW_PREFER_READERS: readers go in as long as no writer holds it,
+//    and are let in first when a writer is done. Writers may starve.
+//  - RW_PREFER_WRITERS: readers wait while writers do, and waiting
+//    writers go before waiting readers. Readers may starve.
+//  - RW_PHASEFAIR (the default): readers wait while writers do, but
+//    those that waited go in as soon as one writer is done, and the
+//    next writer after the readers holding it now. Nobody waits for
+//    more than one phase of the other kind.
+// guard guards all but the words waited on.
+
+#define FUTEX_ALL 0x7fffffff  // futex_wake() all waiters
+
+int
+rwlock_init(rwlock_t *rw)
+{
+  memset((void*)rw, 0, sizeof(*rw));
+  rw->policy = RW_PHASEFAIR;
+  return 0;
+}
+
+// Choose a policy, while nobody holds or waits for rw.
+int
+rwlock_setpolicy(rwlock_t *rw, int policy)
+{
+  if(policy != RW_PREFER_READERS && policy != RW_PREFER_WRITERS &&
+     policy != RW_PHASEFAIR)
+    return -1;
+  ulock(&rw->guard);
+  rw->policy = policy;
+  uunlock(&rw->guard);
+  return 0;
+}
+
+// Hand rw to the next writer. Returns the word to wake up on.
+// rw->guard should be held in caller.
+static volatile uint*
+rwlock_nextwriter(rwlock_t *rw)
+{
+  rw->writer = 1;
+  rw->wwait--;
+  rw->wgrant++;
+  return &rw->wgrant;
+}
+
+// Hand rw to all the waiting readers.
+// rw->guard should be held in caller.
+static volatile uint*
+rwlock_nextreaders(rwlock_t *rw)
+{
+  rw->readers += rw->rwait;
+  rw->rwait = 0;
+  rw->rphase++;
+  return &rw->rphase;
+}
+
+int
+rwlock_acquire_readlock(rwlock_t *rw)
+{
+  uint phase;
+
+  ulock(&rw->guard);
+  if(!rw->writer && (rw->wwait == 0 || rw->policy == RW_PREFER_READERS)){
+    rw->readers++;
+    uunlock(&rw->guard);
+    return 0;
+  }
+  rw->rwait++;
+  phase = rw->rphase;
+  uunlock(&rw->guard);
+  while(rw->rphase == phase)
+    futex_wait(&rw->rphase, phase);
+  return 0;
+}
+
+int
+rwlock_release_readlock(rwlock_t *rw)
+{
+  volatile uint *next = 0;
+
+  ulock(&rw->guard);
+  if(--rw->readers == 0 && rw->wwait > 0)
+    next = rwlock_nextwriter(rw);
+  uunlock(&rw->guard);
+  if(next)
+    futex_wake(next, FUTEX_ALL);
+  return 0;
+}
+
+int
+rwlock_acquire_writelock(rwlock_t *rw)
+{
+  uint ticket, grant;
+
+  ulock(&rw->guard);
+  if(!rw->writer && rw->readers == 0 && rw->wwait == 0){
+    rw->writer = 1;
+    uunlock(&rw->guard);
+    return 0;
+  }
+  rw->wwait++;
+  ticket = rw->wnext++;
+  uunlock(&rw->guard);
+  // Granted once wgrant has gone past the ticket.
+  while((int)((grant = rw->wgrant) - ticket) <= 0)
+    futex_wait(&rw->wgrant, grant);
+  return 0;
+}
+
+int
+rwlock_release_writelock(rwlock_t *rw)
+{
+  volatile uint *next = 0;
+
+  ulock(&rw->guard);
+  rw->writer = 0;
+  if(rw->rwait > 0 && (rw->wwait == 0 || rw->policy != RW_PREFER_WRITERS))
+    next = rwlock_nextreaders(rw);
+  else if(rw->wwait > 0)
+    next = rwlock_nextwriter(rw);
+  uunlock(&rw->guard);
+  if(next)
+    futex_wake(next, FUTEX_ALL);
+  return 0;
+}
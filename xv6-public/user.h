@@ -1,30 +1,41 @@
 struct stat;
 struct rtcdate;
-
-struct spinlock {
-  uint locked;       // Is the lock held?
-  // For debugging:
-  char *name;        // Name of lock.
-  struct cpu *cpu;   // The cpu holding the lock.
-  uint pcs[10];      // The call stack (an array of program counters)
-                     // that locked the lock.
-};
+struct mlfqparam;
+struct lockstatent;
 
 typedef struct _thread_t{
   int thread_id;
   int group_id;
 }thread_t;
 
+// Mutexes, semaphores and readers-writer locks live in user space, on
+// futexes (see ulib.c).
+typedef struct __mutex_t{
+  volatile uint state;    // 0 free, 1 held, 2 held with threads waiting
+  volatile uint owner;    // an address on the holder's stack, 0 if none yet
+}mutex_t;
+
 typedef struct __my_sem_t{
-  int value;
-  int chan;
-  struct spinlock lock;
+  volatile uint value;    // units left
+  volatile uint waiters;  // threads waiting for a unit
+  volatile uint holder;   // an address on the stack of the thread that took the last unit, 0 if none
 }xem_t;
 
+// Readers-writer lock policies, see rwlock_setpolicy().
+#define RW_PREFER_READERS 0
+#define RW_PREFER_WRITERS 1
+#define RW_PHASEFAIR      2
+
 typedef struct __my_rwlock_t{
-  xem_t lock;
-  xem_t writelock;
-  int readers;
+  volatile uint guard;    // lock for the rest
+  int policy;             // who goes next, RW_PREFER_READERS, ...
+  int readers;            // number of readers holding it
+  int writer;             // a writer holds it
+  int rwait;              // number of readers waiting for the next reader phase
+  int wwait;              // number of writers waiting
+  uint wnext;             // ticket of the next writer to wait
+  volatile uint wgrant;   // writers with tickets below it were let in
+  volatile uint rphase;   // counts reader phases, readers wait for the next
 }rwlock_t;
 
 // system calls
@@ -52,8 +63,27 @@ int uptime(void);
 int my_syscall(char*);
 int getppid(void);
 int  yield(void);
+int yield_to(int);
+int thread_setprio(int, int);
 int getlev(void);
+int mlfq_setparam(struct mlfqparam*);
+int mlfq_getparam(struct mlfqparam*);
+int wakelat(int, uint*);
+int futex_wait(volatile uint*, uint);
+int futex_timedwait(volatile uint*, uint, int);
+int futex_wake(volatile uint*, int);
+int lockstat(struct lockstatent*, int, int);
+int thread_running(void*);
+int futex_wait_pi(volatile uint*, uint, void*, int);
+int futex_wake_pi(volatile uint*, int, void*);
 int set_cpu_share(int);
+int set_deadline(int, int);
+int set_affinity(int, int);
+int get_affinity(int);
+int sgroup_create(int);
+int sgroup_weight(int);
+int sgroup_cputime(int);
+int getcputime(void);
 int thread_create(thread_t* thread, void* (*start_rotine) (void*), void* arg);
 void thread_exit(void* retval);
 int thread_join(thread_t thread, void** retval);
@@ -74,13 +104,16 @@ void* malloc(uint);
 void free(void*);
 int atoi(const char*);
 
-// semaphore.c
+int mutex_init(mutex_t*);
+int mutex_lock(mutex_t*);
+int mutex_trylock(mutex_t*);
+int mutex_unlock(mutex_t*);
 int xem_init(xem_t*);
 int xem_wait(xem_t*);
 int xem_post(xem_t*);
-
-// rwlock.c
+int xem_timedwait(xem_t*, int);
 int rwlock_init(rwlock_t*);
+int rwlock_setpolicy(rwlock_t*, int);
 int rwlock_acquire_readlock(rwlock_t*);
 int rwlock_acquire_writelock(rwlock_t*);
 int rwlock_release_readlock(rwlock_t*);
@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -173,10 +174,28 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  // Before the switch, for tlbshootdown() to see; lcr3 serializes.
+  mycpu()->pgdir = p->pgdir;
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
+// Switch the TSS to the kernel stack of p, a thread of the process
+// whose page table is loaded already. Unlike switchuvm(), this keeps
+// the TLB.
+void
+switchkstack(struct proc *p)
+{
+  if(p == 0)
+    panic("switchkstack: no process");
+  if(p->kstack == 0)
+    panic("switchkstack: no kstack");
+
+  pushcli();
+  mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  popcli();
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -252,6 +271,9 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
+// Other threads of the process may be running on other CPUs, so the
+// pages are unmapped first, keeping their addresses in the PTEs, and
+// only freed once no TLB can map them any more.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -261,23 +283,74 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   if(newsz >= oldsz)
     return oldsz;
 
-  a = PGROUNDUP(newsz);
-  for(; a  < oldsz; a += PGSIZE){
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
     else if((*pte & PTE_P) != 0){
-      pa = PTE_ADDR(*pte);
-      if(pa == 0)
+      if(PTE_ADDR(*pte) == 0)
         panic("kfree");
-      char *v = P2V(pa);
-      kfree(v);
+      *pte &= ~PTE_P;
+    }
+  }
+  tlbshootdown(pgdir);
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(*pte != 0){
+      pa = PTE_ADDR(*pte);
+      kfree(P2V(pa));
       *pte = 0;
     }
   }
   return newsz;
 }
 
+// Make every CPU drop the TLB entries it may have for pgdir, whose PTEs
+// the caller just changed, and wait until they have. A CPU can only
+// have them while pgdir is loaded, as a %cr3 load drops all user ones.
+// The others get an IPI, but may not take it while they spin for a lock
+// the caller holds: they look for the request there too (tlbcheck()).
+void
+tlbshootdown(pde_t *pgdir)
+{
+  struct cpu *c, *me;
+  uint asked = 0;
+
+  pushcli();
+  me = mycpu();
+  // PTE changes before the looks at pgdir, as in switchuvm().
+  __sync_synchronize();
+  if(me->pgdir == pgdir)
+    lcr3(V2P(pgdir));
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c != me && c->pgdir == pgdir){
+      xchg(&c->tlbflush, 1);
+      lapicipi(c->apicid, T_IRQ0 + IRQ_TLBFLUSH);
+      asked |= 1 << (c - cpus);
+    }
+  }
+  for(c = cpus; c < cpus+ncpu; c++){
+    while(((asked >> (c - cpus)) & 1) && c->tlbflush){
+      // Another CPU may be waiting for this one in turn.
+      tlbcheck(me);
+      pause();
+    }
+  }
+  popcli();
+}
+
+// Drop this CPU's TLB if tlbshootdown() asked for it.
+// Interrupts should be off.
+void
+tlbcheck(struct cpu *c)
+{
+  // Taking the request before the reload lets one made meanwhile stand.
+  if(c->tlbflush && xchg(&c->tlbflush, 0))
+    lcr3(rcr3());
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void